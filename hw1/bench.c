@@ -0,0 +1,265 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define MAX_ARGS 16
+
+// Тестовый файл
+typedef struct {
+    const char *name;     // Имя файла в рабочем каталоге
+    long long size;       // Видимый размер
+    int sparse;           // 1 - файл почти целиком из дыр
+} test_file_t;
+
+static const test_file_t files[] = {
+    { "tiny",   100,                  0 },
+    { "4k",     4096,                 0 },
+    { "1m",     1024 * 1024,          0 },
+    { "1g",     1024LL * 1024 * 1024, 0 },
+    { "sparse", 1024LL * 1024 * 1024, 1 },
+};
+
+// Стратегия копирования - набор ключей для main
+typedef struct {
+    const char *name;
+    const char *args[MAX_ARGS];
+} strategy_t;
+
+static const strategy_t strategies[] = {
+    { "rw32",      { "-m", "rw", "-b", "32", NULL } },       // исходный цикл с буфером 32 байта
+    { "rw4k",      { "-m", "rw", "-b", "4096", NULL } },
+    { "rw64k",     { "-m", "rw", "-b", "65536", NULL } },
+    { "rw1m",      { "-m", "rw", "-b", "1048576", NULL } },
+    { "rw_auto",   { "-m", "rw", NULL } },                    // буфер подбирается по файлу
+    { "mmap",      { "-m", "mmap", NULL } },
+    { "cfr",       { "-m", "cfr", NULL } },
+    { "sendfile",  { "-m", "sendfile", NULL } },
+    { "uring",     { "-m", "uring", NULL } },
+    { "parallel4", { "-j", "4", NULL } },
+    { "sparse",    { "-s", NULL } },
+};
+
+#define NFILES (int)(sizeof(files) / sizeof(files[0]))
+#define NSTRATEGIES (int)(sizeof(strategies) / sizeof(strategies[0]))
+
+// Результат одного запуска
+typedef struct {
+    double seconds;       // Время по часам
+    double user, sys;     // Процессорное время
+    long maxrss_kb;       // Пиковый RSS
+    long long rw_calls;   // Вызовы чтения и записи (syscr + syscw), не все системные вызовы
+    int status;           // Код завершения main
+} run_result_t;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Создаёт тестовый файл со случайными данными; у разреженного данные только в двух местах
+static int make_file(const char *path, const test_file_t *f) {
+    struct stat st;
+    if (stat(path, &st) == 0 && st.st_size == f->size)
+        return 0; // уже создан прошлым запуском
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+
+    static char buf[1024 * 1024];
+    unsigned int seed = 12345;
+    for (size_t i = 0; i < sizeof(buf); i++)
+        buf[i] = rand_r(&seed);
+
+    if (f->sparse) {
+        // 1 МБ данных в начале и 1 МБ в середине, остальное - дыры
+        if (pwrite(fd, buf, sizeof(buf), 0) < 0 ||
+            pwrite(fd, buf, sizeof(buf), f->size / 2) < 0 ||
+            ftruncate(fd, f->size) < 0) {
+            perror(path);
+            close(fd);
+            return -1;
+        }
+    } else {
+        for (long long off = 0; off < f->size; off += sizeof(buf)) {
+            size_t n = f->size - off < (long long)sizeof(buf) ? (size_t)(f->size - off) : sizeof(buf);
+            buf[0] = (char)off; // чтобы мегабайты не совпадали
+            if (write(fd, buf, n) != (ssize_t)n) {
+                perror(path);
+                close(fd);
+                return -1;
+            }
+        }
+    }
+    // Данные должны быть на диске, иначе DONTNEED не сможет выбросить грязные страницы
+    fsync(fd);
+    close(fd);
+    return 0;
+}
+
+// Холодный кэш: выбрасываем страницы файла. Тёплый: читаем его целиком.
+static void prepare_cache(const char *path, int cold) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return;
+    if (cold) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    } else {
+        static char buf[1024 * 1024];
+        while (read(fd, buf, sizeof(buf)) > 0)
+            ;
+    }
+    close(fd);
+}
+
+// Читает счётчики syscr и syscw из /proc/<pid>/io
+static long long read_rw_calls(pid_t pid) {
+    char path[64], line[128];
+    long long total = 0, v;
+    snprintf(path, sizeof(path), "/proc/%d/io", pid);
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return -1;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "syscr: %lld", &v) == 1 || sscanf(line, "syscw: %lld", &v) == 1)
+            total += v;
+    }
+    fclose(f);
+    return total;
+}
+
+// Запускает main со стратегией s на паре файлов и собирает статистику процесса
+static int run_copy(const char *prog, const strategy_t *s, const char *src, const char *dst,
+                    run_result_t *r) {
+    const char *argv[MAX_ARGS + 5];
+    int n = 0;
+    argv[n++] = prog;
+    for (int i = 0; s->args[i]; i++)
+        argv[n++] = s->args[i];
+    argv[n++] = "-q";
+    argv[n++] = src;
+    argv[n++] = dst;
+    argv[n] = NULL;
+
+    unlink(dst);
+    double start = now_sec();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        execv(prog, (char *const *)argv);
+        perror(prog);
+        _exit(127);
+    }
+
+    // Ждём завершения, не забирая зомби: /proc/<pid>/io ещё доступен
+    siginfo_t info;
+    waitid(P_PID, pid, &info, WEXITED | WNOWAIT);
+    r->seconds = now_sec() - start;
+    r->rw_calls = read_rw_calls(pid);
+
+    struct rusage ru;
+    int status;
+    wait4(pid, &status, 0, &ru);
+    r->user = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6;
+    r->sys = ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+    r->maxrss_kb = ru.ru_maxrss;
+    r->status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Использование: %s [-d рабочий_каталог] [-p путь_к_main] [-n повторов]\n"
+            "          [-L макс_размер] [-c cold|warm|both]\n",
+            prog);
+}
+
+int main(int argc, char *argv[]) {
+    const char *dir = ".";           // Каталог на проверяемой ФС
+    const char *prog = "./main";     // Копировщик
+    int repeats = 3;
+    long long max_size = -1;         // Пропускать файлы больше этого размера
+    int cold_from = 0, cold_to = 1;  // 0 - тёплый кэш, 1 - холодный
+    int c;
+
+    while ((c = getopt(argc, argv, "d:p:n:L:c:")) != -1) {
+        switch (c) {
+        case 'd': dir = optarg; break;
+        case 'p': prog = optarg; break;
+        case 'n': repeats = atoi(optarg); break;
+        case 'L': max_size = strtoll(optarg, NULL, 0); break;
+        case 'c':
+            if (strcmp(optarg, "warm") == 0)      cold_from = cold_to = 0;
+            else if (strcmp(optarg, "cold") == 0) cold_from = cold_to = 1;
+            else if (strcmp(optarg, "both") != 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    char prog_path[4096];
+    if (!realpath(prog, prog_path)) {
+        perror(prog);
+        return 1;
+    }
+
+    // Таблица для машинной обработки - CSV в stdout, ход работы - в stderr
+    printf("file,size,strategy,cache,run,seconds,mb_s,rw_calls,user_s,sys_s,maxrss_kb,status\n");
+
+    for (int fi = 0; fi < NFILES; fi++) {
+        const test_file_t *f = &files[fi];
+        if (max_size >= 0 && f->size > max_size)
+            continue;
+
+        char src[4096], dst[4096];
+        snprintf(src, sizeof(src), "%s/bench_%s.src", dir, f->name);
+        snprintf(dst, sizeof(dst), "%s/bench_%s.dst", dir, f->name);
+        fprintf(stderr, "Файл %s (%lld байт)\n", f->name, f->size);
+        if (make_file(src, f) < 0)
+            return 1;
+
+        for (int si = 0; si < NSTRATEGIES; si++) {
+            const strategy_t *s = &strategies[si];
+            // Режим -s осмыслен только для разреженного файла
+            if (strcmp(s->name, "sparse") == 0 && !f->sparse)
+                continue;
+
+            for (int cold = cold_from; cold <= cold_to; cold++) {
+                for (int run = 1; run <= repeats; run++) {
+                    run_result_t r;
+                    prepare_cache(src, cold);
+                    if (run_copy(prog_path, s, src, dst, &r) < 0)
+                        return 1;
+
+                    double mb_s = r.seconds > 0 ? f->size / (1024.0 * 1024.0) / r.seconds : 0;
+                    printf("%s,%lld,%s,%s,%d,%.6f,%.1f,%lld,%.3f,%.3f,%ld,%d\n",
+                           f->name, f->size, s->name, cold ? "cold" : "warm", run,
+                           r.seconds, mb_s, r.rw_calls, r.user, r.sys, r.maxrss_kb, r.status);
+                    fflush(stdout);
+                }
+            }
+        }
+        unlink(dst);
+    }
+    return 0;
+}
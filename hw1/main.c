@@ -1,49 +1,1943 @@
-#include <unistd.h>     
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
 
-#define BUF_SIZE 32     // размер буфера 32 байта
+#define MIN_BUF_SIZE (128 * 1024)       // минимальный буфер для read/write - 128 КБ
+#define MAX_BUF_SIZE (8 * 1024 * 1024)  // максимальный буфер - 8 МБ
+#define KERNEL_CHUNK (1 << 30)          // сколько просим у ядра за один вызов - 1 ГБ
+#define DEFAULT_CHUNK (8 * 1024 * 1024) // размер куска в параллельном режиме - 8 МБ
+#define MAX_THREADS 256                 // ограничение на число потоков
+#define URING_BUF_SIZE (1024 * 1024)    // буфер одного запроса io_uring - 1 МБ
+#define URING_DEPTH 8                   // глубина очереди io_uring по умолчанию
+#define MAX_URING_DEPTH 128
+#define TREE_QUEUE_SIZE 1024            // сколько файлов может ждать копирования в режиме -r
+#define JOURNAL_EVERY 16                // раз в сколько кусков сбрасывать журнал в режиме -R
+#define JOURNAL_MAGIC "ACSJRNL1"
+#define STREAM_WINDOW (8 * 1024 * 1024) // окно сброса page cache в режиме -S fadvise
+#define DIRECT_ALIGN 4096               // выравнивание буфера и смещений для O_DIRECT
+#define DELTA_BLOCK (64 * 1024)         // размер сравниваемого блока в режиме -d
+#define DIR_CACHE_SIZE 64               // сколько дескрипторов каталогов держать в режиме -B
 
-int main(int argc, char *argv[])
-{
+// Способы копирования, от самого быстрого к самому медленному
+typedef enum {
+    COPY_AUTO,      // перебрать способы по очереди
+    COPY_CFR,       // copy_file_range - копирование внутри ядра (или reflink ФС)
+    COPY_SENDFILE,  // sendfile - копирование через page cache без userspace
+    COPY_RW,        // обычный read/write через буфер
+    COPY_URING,     // асинхронный конвейер чтений/записей через io_uring
+    COPY_MMAP       // src отображается в память и пишется write прямо из отображения
+} copy_method_t;
+
+static const char *method_names[] = { "auto", "copy_file_range", "sendfile", "read/write", "io_uring", "mmap" };
+
+// Параметры запуска
+typedef struct {
+    copy_method_t method; // Выбранный способ (-m)
+    size_t buf_size;      // Размер буфера для read/write (-b), 0 - подобрать по файлу
+    int quiet;            // Не печатать отчёт (-q)
+    int sparse;           // Копировать только данные, сохраняя дыры (-s)
+    int threads;          // Число потоков параллельного копирования (-j)
+    size_t chunk_size;    // Размер куска для параллельного копирования и журнала (-c)
+    int uring_depth;      // Сколько запросов io_uring держать в полёте (-u)
+    int recursive;        // Копировать дерево каталогов (-r)
+    int keep_times;       // Переносить время доступа и изменения (в режиме -r)
+    int checksum;         // Считать CRC32C данных во время копирования (-k)
+    int write_sum;        // Записать контрольную сумму в dst.crc32c (-w)
+    int verify_sum;       // Сверить контрольную сумму с src.crc32c (-v)
+    int resume;           // Возобновляемое копирование с журналом dst.journal (-R)
+    int journal_every;    // Раз в сколько кусков фиксировать журнал (-J)
+    int stream;           // Не засорять page cache (-S): 0 - нет, STREAM_DIRECT, STREAM_FADVISE
+    int delta;            // Переписывать только изменившиеся блоки существующего dst (-d)
+    const char *manifest; // Список пар "src<TAB>dst" для пакетного режима (-B), "-" - stdin
+} options_t;
+
+// Режимы копирования в обход page cache (-S)
+enum { STREAM_NONE, STREAM_DIRECT, STREAM_FADVISE };
+
+// Итог копирования одного файла
+typedef struct {
+    copy_method_t used;   // Каким способом реально скопировали
+    long long bytes;      // Размер получившегося файла
+    long long copied;     // Сколько байт данных реально перенесено
+    long long allocated;  // Сколько байт занято на диске у целевого файла
+    uint32_t crc;         // CRC32C скопированных данных (если включён -k)
+    long long resumed;    // С какого байта продолжено копирование (-R), -1 - с начала
+    int stream_used;      // Каким режимом -S реально скопировали
+    long long cache_before, cache_after;   // Cached из /proc/meminfo, КБ
+    long long src_pages_before, src_pages_after, dst_pages_after; // страниц файлов в кэше
+    long long blocks, changed_blocks; // Всего блоков и переписанных блоков (-d)
+    double seconds;       // Сколько времени заняло
+} copy_stats_t;
+
+// Текущее время в секундах (монотонные часы)
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// CRC32C (полином Castagnoli). На x86-64 с SSE4.2 считается инструкцией crc32
+// по 8 байт за раз, иначе - таблицами slicing-by-8.
+static uint32_t crc32c_table[8][256];
+static uint32_t (*crc32c_update)(uint32_t crc, const unsigned char *p, size_t n);
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+
+static uint32_t crc32c_sw(uint32_t crc, const unsigned char *p, size_t n) {
+    while (n && ((uintptr_t)p & 7)) {
+        crc = crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        n--;
+    }
+    while (n >= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        w ^= crc;
+        crc = crc32c_table[7][w & 0xff] ^ crc32c_table[6][(w >> 8) & 0xff] ^
+              crc32c_table[5][(w >> 16) & 0xff] ^ crc32c_table[4][(w >> 24) & 0xff] ^
+              crc32c_table[3][(w >> 32) & 0xff] ^ crc32c_table[2][(w >> 40) & 0xff] ^
+              crc32c_table[1][(w >> 48) & 0xff] ^ crc32c_table[0][w >> 56];
+        p += 8;
+        n -= 8;
+    }
+    while (n--)
+        crc = crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const unsigned char *p, size_t n) {
+    uint64_t c = crc;
+    while (n && ((uintptr_t)p & 7)) {
+        c = _mm_crc32_u8((uint32_t)c, *p++);
+        n--;
+    }
+    // По 32 байта за итерацию, чтобы цикл не упирался в накладные расходы
+    while (n >= 32) {
+        const uint64_t *q = (const uint64_t *)p;
+        c = _mm_crc32_u64(c, q[0]);
+        c = _mm_crc32_u64(c, q[1]);
+        c = _mm_crc32_u64(c, q[2]);
+        c = _mm_crc32_u64(c, q[3]);
+        p += 32;
+        n -= 32;
+    }
+    while (n >= 8) {
+        c = _mm_crc32_u64(c, *(const uint64_t *)p);
+        p += 8;
+        n -= 8;
+    }
+    while (n--)
+        c = _mm_crc32_u8((uint32_t)c, *p++);
+    return (uint32_t)c;
+}
+#endif
+
+static void crc32c_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+            c = (c & 1) ? (c >> 1) ^ 0x82F63B78 : c >> 1;
+        crc32c_table[0][i] = c;
+    }
+    for (int t = 1; t < 8; t++)
+        for (int i = 0; i < 256; i++)
+            crc32c_table[t][i] = crc32c_table[0][crc32c_table[t - 1][i] & 0xff] ^ (crc32c_table[t - 1][i] >> 8);
+
+    crc32c_update = crc32c_sw;
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("sse4.2"))
+        crc32c_update = crc32c_hw;
+#endif
+}
+
+// Продолжает CRC32C crc на n байт из buf (начальное значение - 0, как у crc32 из zlib)
+static uint32_t crc32c(uint32_t crc, const void *buf, size_t n) {
+    pthread_once(&crc32c_once, crc32c_init);
+    return ~crc32c_update(~crc, buf, n);
+}
+
+// Продолжает CRC32C на len нулевых байт (дыры разреженного файла)
+static uint32_t crc32c_zeros(uint32_t crc, off_t len) {
+    static const unsigned char zeros[65536];
+    while (len > 0) {
+        size_t n = len < (off_t)sizeof(zeros) ? (size_t)len : sizeof(zeros);
+        crc = crc32c(crc, zeros, n);
+        len -= n;
+    }
+    return crc;
+}
+
+// Ошибки, после которых имеет смысл попробовать следующий способ копирования
+static int is_unsupported(int err) {
+    return err == EXDEV || err == EINVAL || err == ENOSYS ||
+           err == EOPNOTSUPP || err == EBADF || err == ESPIPE || err == ENODEV;
+}
+
+// Подбор размера буфера: не меньше блока ФС и MIN_BUF_SIZE, не больше файла и MAX_BUF_SIZE
+static size_t choose_buf_size(const struct stat *st, const options_t *opt) {
+    if (opt->buf_size)
+        return opt->buf_size;
+
+    size_t size = MIN_BUF_SIZE;
+    if ((size_t)st->st_blksize > size)
+        size = st->st_blksize;
+    // Для больших файлов буфер растёт, чтобы сократить число системных вызовов
+    while (size < MAX_BUF_SIZE && (off_t)size * 64 < st->st_size)
+        size *= 2;
+    return size;
+}
+
+// Буфер для read/write, общий для всех файлов, которые копирует этот поток.
+// При копировании миллионов мелких файлов malloc/free на каждый файл заметны.
+static __thread char *rw_buf;
+static __thread size_t rw_buf_size;
+
+static char *get_rw_buf(size_t size) {
+    if (size > rw_buf_size) {
+        char *buf = realloc(rw_buf, size);
+        if (!buf)
+            return NULL;
+        rw_buf = buf;
+        rw_buf_size = size;
+    }
+    return rw_buf;
+}
+
+// Записываем ровно n байт по смещению off, повторяя частичные записи
+static int pwrite_all(int fd, const char *buf, size_t n, off_t off) {
+    size_t total_written = 0;
+    while (total_written < n) {
+        ssize_t nw = pwrite(fd, buf + total_written, n - total_written, off + total_written);
+        if (nw < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        total_written += nw;
+    }
+    return 0;
+}
+
+// Читаем ровно n байт по смещению off; если файл кончился раньше - ошибка EIO
+static int pread_all(int fd, char *buf, size_t n, off_t off) {
+    size_t total_read = 0;
+    while (total_read < n) {
+        ssize_t nr = pread(fd, buf + total_read, n - total_read, off + total_read);
+        if (nr < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (nr == 0) {
+            errno = EIO;
+            return -1;
+        }
+        total_read += nr;
+    }
+    return 0;
+}
+
+// copy_file_range: копируем len байт (len < 0 - до конца файла), в *done - сколько успели
+static int copy_cfr(int fd_src, int fd_dst, off_t off, off_t len, off_t *done) {
+    *done = 0;
+    while (len < 0 || *done < len) {
+        off_t in_off = off + *done;
+        off_t out_off = in_off;
+        size_t want = (len < 0 || len - *done > KERNEL_CHUNK) ? KERNEL_CHUNK : (size_t)(len - *done);
+
+        ssize_t n = copy_file_range(fd_src, &in_off, fd_dst, &out_off, want, 0);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (n == 0)
+            break; // конец исходного файла
+        *done += n;
+    }
+    return 0;
+}
+
+// sendfile: ядро само читает из fd_src и пишет в fd_dst с его текущей позиции
+static int copy_sendfile(int fd_src, int fd_dst, off_t off, off_t len, off_t *done) {
+    *done = 0;
+    if (lseek(fd_dst, off, SEEK_SET) < 0)
+        return -1;
+    while (len < 0 || *done < len) {
+        off_t in_off = off + *done;
+        size_t want = (len < 0 || len - *done > KERNEL_CHUNK) ? KERNEL_CHUNK : (size_t)(len - *done);
+
+        ssize_t n = sendfile(fd_dst, fd_src, &in_off, want);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (n == 0)
+            break;
+        *done += n;
+    }
+    return 0;
+}
+
+// mmap: диапазон src отображается в память, и данные пишутся в dst прямо из
+// отображения, без промежуточного буфера
+static int copy_mmap(int fd_src, int fd_dst, off_t off, off_t len, off_t *done) {
+    long page = sysconf(_SC_PAGESIZE);
+    off_t map_off = off / page * page; // смещение отображения должно быть кратно странице
+    size_t map_len = len + (off - map_off);
+
+    *done = 0;
+    if (len == 0)
+        return 0;
+    char *map = mmap(NULL, map_len, PROT_READ, MAP_SHARED, fd_src, map_off);
+    if (map == MAP_FAILED)
+        return -1;
+    madvise(map, map_len, MADV_SEQUENTIAL);
+
+    int rc = 0;
+    while (*done < len) {
+        size_t n = len - *done > KERNEL_CHUNK ? KERNEL_CHUNK : (size_t)(len - *done);
+        if (pwrite_all(fd_dst, map + (off - map_off) + *done, n, off + *done) < 0) {
+            rc = -1;
+            break;
+        }
+        *done += n;
+    }
+    munmap(map, map_len);
+    return rc;
+}
+
+// read/write через буфер buf размера buf_size. Если crc != NULL, контрольная сумма
+// считается по только что прочитанным данным, пока они ещё в кэше процессора.
+static int copy_rw(int fd_src, int fd_dst, off_t off, off_t len,
+                   char *buf, size_t buf_size, off_t *done, uint32_t *crc) {
+    *done = 0;
+    while (len < 0 || *done < len) {
+        size_t want = (len < 0 || (off_t)buf_size < len - *done) ? buf_size : (size_t)(len - *done);
+
+        ssize_t nread = pread(fd_src, buf, want, off + *done);
+        if (nread < 0) {
+            if (errno == EINTR)
+                continue;
+            // pread не работает на каналах - читаем последовательно
+            if (errno == ESPIPE)
+                nread = read(fd_src, buf, want);
+            if (nread < 0)
+                return -1;
+        }
+        if (nread == 0)
+            break;
+        if (crc)
+            *crc = crc32c(*crc, buf, nread);
+        if (pwrite_all(fd_dst, buf, nread, off + *done) < 0)
+            return -1;
+        *done += nread;
+    }
+    return 0;
+}
+
+// Кольца io_uring, отображённые в память процесса. liburing не используется,
+// кольца настраиваются напрямую через системные вызовы.
+typedef struct {
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr, *cq_ptr;
+    size_t sq_size, cq_size, sqes_size;
+} uring_t;
+
+// Состояние одного буфера конвейера
+typedef enum { SLOT_FREE, SLOT_READING, SLOT_WRITING } slot_state_t;
+
+typedef struct {
+    slot_state_t state;
+    off_t off;            // Смещение куска в файле
+    size_t len;           // Длина куска
+    size_t done;          // Сколько уже прочитано/записано (для коротких операций)
+} uring_slot_t;
+
+static void uring_free(uring_t *ring) {
+    if (ring->sqes && ring->sqes != MAP_FAILED)
+        munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ptr && ring->cq_ptr != MAP_FAILED && ring->cq_ptr != ring->sq_ptr)
+        munmap(ring->cq_ptr, ring->cq_size);
+    if (ring->sq_ptr && ring->sq_ptr != MAP_FAILED)
+        munmap(ring->sq_ptr, ring->sq_size);
+    close(ring->fd);
+}
+
+static int uring_setup(uring_t *ring, unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    memset(ring, 0, sizeof(*ring));
+
+    ring->fd = syscall(SYS_io_uring_setup, entries, &p);
+    if (ring->fd < 0)
+        return -1;
+
+    ring->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    // Начиная с 5.4 обе очереди лежат в одном отображении
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_size > ring->sq_size)
+            ring->sq_size = ring->cq_size;
+        ring->cq_size = ring->sq_size;
+    }
+
+    ring->sq_ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED)
+        goto fail;
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ptr = ring->sq_ptr;
+    } else {
+        ring->cq_ptr = mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ptr == MAP_FAILED)
+            goto fail;
+    }
+    ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED)
+        goto fail;
+
+    char *sq = ring->sq_ptr, *cq = ring->cq_ptr;
+    ring->sq_head = (unsigned *)(sq + p.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return 0;
+
+fail:
+    // Уже созданные отображения снимаются так же, как при обычном освобождении
+    uring_free(ring);
+    return -1;
+}
+
+// Кладёт в очередь отправки чтение или запись куска slot из буфера buf
+static void uring_queue(uring_t *ring, int op, int fd, char *buf, unsigned buf_index,
+                        int fixed, const uring_slot_t *slot, unsigned idx) {
+    unsigned tail = *ring->sq_tail;
+    unsigned i = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[i];
+
+    memset(sqe, 0, sizeof(*sqe));
+    if (op == SLOT_READING)
+        sqe->opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    else
+        sqe->opcode = fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->off = slot->off + slot->done;
+    sqe->addr = (unsigned long)(buf + slot->done);
+    sqe->len = slot->len - slot->done;
+    sqe->buf_index = buf_index;
+    sqe->user_data = idx;
+
+    ring->sq_array[i] = i;
+    // Ядро должно увидеть заполненный sqe раньше нового хвоста
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+// Дожидается завершения inflight запросов, не глядя на результат. Запросы, которые
+// лежат в очереди отправки, но ещё не переданы ядру, отправляются тем же вызовом.
+static int uring_drain(uring_t *ring, unsigned inflight) {
+    while (1) {
+        unsigned head = *ring->cq_head;
+        unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        inflight -= tail - head;
+        __atomic_store_n(ring->cq_head, tail, __ATOMIC_RELEASE);
+        if (inflight == 0)
+            return 0;
+
+        unsigned pending = *ring->sq_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+        if (syscall(SYS_io_uring_enter, ring->fd, pending, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0
+            && errno != EINTR)
+            return -1;
+    }
+}
+
+// Конвейер io_uring: depth буферов, каждый по кругу читается из fd_src и пишется в fd_dst.
+// Пока пишется кусок i, в полёте уже чтения кусков i+1..i+depth.
+static int copy_uring(int fd_src, int fd_dst, off_t off, off_t len,
+                      const options_t *opt, off_t *done) {
+    unsigned depth = opt->uring_depth > 0 ? opt->uring_depth : URING_DEPTH;
+    size_t buf_size = opt->buf_size ? opt->buf_size : URING_BUF_SIZE;
+    uring_slot_t slots[MAX_URING_DEPTH];
+    struct iovec iov[MAX_URING_DEPTH];
+    uring_t ring;
+    int rc = -1, err = 0;
+
+    *done = 0;
+    if (len == 0)
+        return 0;
+    if (depth > MAX_URING_DEPTH)
+        depth = MAX_URING_DEPTH;
+
+    if (uring_setup(&ring, depth) < 0) {
+        errno = ENOSYS; // io_uring нет в ядре или он запрещён - пусть вызывающий откатится
+        return -1;
+    }
+
+    char *bufs = NULL;
+    if (posix_memalign((void **)&bufs, 4096, depth * buf_size) != 0) {
+        uring_free(&ring);
+        errno = ENOMEM;
+        return -1;
+    }
+    for (unsigned i = 0; i < depth; i++) {
+        iov[i].iov_base = bufs + i * buf_size;
+        iov[i].iov_len = buf_size;
+        slots[i].state = SLOT_FREE;
+    }
+    // Зарегистрированные буферы ядро не закрепляет заново на каждый запрос.
+    // Если не хватает RLIMIT_MEMLOCK, работаем с обычными буферами.
+    int fixed = syscall(SYS_io_uring_register, ring.fd, IORING_REGISTER_BUFFERS, iov, depth) == 0;
+
+    off_t next_off = off;           // Откуда читать следующий кусок
+    off_t end = off + len;
+    off_t hole = end;               // Начало первого куска, который точно не записан
+    unsigned inflight = 0;
+
+    // После ошибки новых запросов не отправляем, но дожидаемся всех, что уже в полёте,
+    // иначе ядро может писать в уже освобождённые буферы
+    while ((next_off < end && !err) || inflight > 0) {
+        unsigned to_submit = 0;
+
+        // Все свободные буферы отправляем на чтение следующих кусков
+        for (unsigned i = 0; i < depth && next_off < end && !err; i++) {
+            if (slots[i].state != SLOT_FREE)
+                continue;
+            slots[i].state = SLOT_READING;
+            slots[i].off = next_off;
+            slots[i].len = end - next_off < (off_t)buf_size ? (size_t)(end - next_off) : buf_size;
+            slots[i].done = 0;
+            next_off += slots[i].len;
+            uring_queue(&ring, SLOT_READING, fd_src, iov[i].iov_base, i, fixed, &slots[i], i);
+            to_submit++;
+            inflight++;
+        }
+
+        // Отправляем новые запросы и ждём хотя бы одно завершение одним вызовом
+        if (syscall(SYS_io_uring_enter, ring.fd, to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0) {
+            if (errno == EINTR)
+                continue;
+            if (!err)
+                err = errno;
+            break;
+        }
+
+        unsigned head = *ring.cq_head;
+        unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+        to_submit = 0;
+        for (; head != tail; head++) {
+            struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cq_mask];
+            unsigned i = cqe->user_data;
+            int res = cqe->res;
+
+            if (err || res <= 0) {
+                // Ошибка или файл укоротился во время копирования
+                if (!err)
+                    err = res < 0 ? -res : EIO;
+                if (slots[i].off < hole)
+                    hole = slots[i].off;
+                slots[i].state = SLOT_FREE;
+                inflight--;
+                continue;
+            }
+            slots[i].done += res;
+            if (slots[i].done < slots[i].len) {
+                // Короткая операция: дочитываем/дописываем остаток того же куска
+                uring_queue(&ring, slots[i].state, slots[i].state == SLOT_READING ? fd_src : fd_dst,
+                            iov[i].iov_base, i, fixed, &slots[i], i);
+                to_submit++;
+            } else if (slots[i].state == SLOT_READING) {
+                // Кусок прочитан - сразу отправляем его на запись
+                slots[i].state = SLOT_WRITING;
+                slots[i].done = 0;
+                uring_queue(&ring, SLOT_WRITING, fd_dst, iov[i].iov_base, i, fixed, &slots[i], i);
+                to_submit++;
+            } else {
+                slots[i].state = SLOT_FREE;
+                inflight--;
+            }
+        }
+        __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+
+        if (to_submit && syscall(SYS_io_uring_enter, ring.fd, to_submit, 0, 0, NULL, 0) < 0) {
+            if (!err)
+                err = errno;
+            break;
+        }
+    }
+    if (!err)
+        rc = 0;
+
+    // Куски завершаются не по порядку, а вызывающий продолжает копирование с off + *done.
+    // Поэтому сообщаем только о сплошном начале диапазона: до первого куска, который
+    // не удался или не успел завершиться
+    for (unsigned i = 0; i < depth; i++)
+        if (slots[i].state != SLOT_FREE && slots[i].off < hole)
+            hole = slots[i].off;
+    if (next_off < hole)
+        hole = next_off;
+    *done = hole - off;
+
+    // Сюда можно попасть после сбоя io_uring_enter, когда запросы ещё в полёте.
+    // Закрытие кольца их не ждёт, поэтому буферы освобождаем только после завершения
+    // всех запросов. Если не удалось дождаться и этого, буферы лучше потерять.
+    int drained = inflight == 0 || uring_drain(&ring, inflight) == 0;
+    uring_free(&ring);
+    if (drained)
+        free(bufs);
+    if (rc < 0)
+        errno = err;
+    return rc;
+}
+
+// Копирует диапазон [off, off + len) способом из opt, при неудаче переходит к следующему.
+// В *used записывается способ, которым скопирована последняя часть диапазона.
+// Если нужна контрольная сумма (crc != NULL), данные должны пройти через процесс,
+// поэтому используется только read/write.
+static int copy_range(int fd_src, int fd_dst, off_t off, off_t len, const struct stat *st,
+                      const options_t *opt, copy_method_t *used, uint32_t *crc) {
+    copy_method_t m = opt->method == COPY_AUTO ? COPY_CFR : opt->method;
+    if (crc)
+        m = COPY_RW;
+
+    // io_uring и mmap пробуем отдельно: если они недоступны, переходим на синхронный read/write
+    if (m == COPY_URING || m == COPY_MMAP) {
+        off_t done = 0;
+        *used = m;
+        if (len >= 0) {
+            int rc = m == COPY_URING ? copy_uring(fd_src, fd_dst, off, len, opt, &done)
+                                     : copy_mmap(fd_src, fd_dst, off, len, &done);
+            if (rc == 0)
+                return 0;
+            if (!is_unsupported(errno))
+                return -1;
+            off += done;
+            len -= done;
+        }
+        m = COPY_RW;
+    }
+
+    for (; m <= COPY_RW; m++) {
+        off_t done = 0;
+        int rc;
+
+        if (m == COPY_CFR) {
+            rc = copy_cfr(fd_src, fd_dst, off, len, &done);
+        } else if (m == COPY_SENDFILE) {
+            rc = copy_sendfile(fd_src, fd_dst, off, len, &done);
+        } else {
+            size_t buf_size = choose_buf_size(st, opt);
+            char *buf = get_rw_buf(buf_size);
+            if (!buf)
+                return -1;
+            rc = copy_rw(fd_src, fd_dst, off, len, buf, buf_size, &done, crc);
+        }
+
+        *used = m;
+        if (rc == 0)
+            return 0;
+        // Явно заданный способ не подменяем, а в режиме auto продолжаем с места остановки
+        if (opt->method != COPY_AUTO || crc || !is_unsupported(errno))
+            return -1;
+        off += done;
+        if (len >= 0)
+            len -= done;
+    }
+    return -1;
+}
+
+// Копирует только области с данными, обходя их через SEEK_DATA/SEEK_HOLE.
+// Дыры в целевом файле не записываются, а размер выставляется через ftruncate.
+static int copy_sparse(int fd_src, int fd_dst, const struct stat *st,
+                       const options_t *opt, copy_stats_t *stats) {
+    uint32_t *crc = opt->checksum ? &stats->crc : NULL;
+    off_t pos = 0;
+    stats->copied = 0;
+
+    while (pos < st->st_size) {
+        off_t data = lseek(fd_src, pos, SEEK_DATA);
+        if (data < 0) {
+            if (errno == ENXIO)
+                break; // дальше до конца файла только дыра
+            if (errno == EINVAL && pos == 0) {
+                // ФС не умеет SEEK_DATA - копируем файл целиком
+                stats->copied = st->st_size;
+                return copy_range(fd_src, fd_dst, 0, st->st_size, st, opt, &stats->used, crc);
+            }
+            return -1;
+        }
+        off_t hole = lseek(fd_src, data, SEEK_HOLE);
+        if (hole < 0 || hole > st->st_size)
+            hole = st->st_size;
+
+        // Дыра читается как нули - контрольная сумма должна совпасть с плотной копией
+        if (crc)
+            *crc = crc32c_zeros(*crc, data - pos);
+        if (copy_range(fd_src, fd_dst, data, hole - data, st, opt, &stats->used, crc) < 0)
+            return -1;
+        stats->copied += hole - data;
+        pos = hole;
+    }
+
+    if (crc)
+        *crc = crc32c_zeros(*crc, st->st_size - pos);
+    // Если файл заканчивается дырой, данные до конца не дописаны - восстанавливаем размер
+    return ftruncate(fd_dst, st->st_size);
+}
+
+// Общее задание для потоков параллельного копирования
+typedef struct {
     int fd_src;
     int fd_dst;
-    ssize_t nread;
-    char buf[BUF_SIZE];
+    off_t size;           // Размер файла
+    size_t chunk_size;    // Размер одного куска
+    off_t next_chunk;     // Номер следующего свободного куска
+    int error;            // errno первой ошибки, 0 - ошибок нет
+    pthread_mutex_t m;    // Защищает next_chunk и error
+} parallel_job_t;
+
+// Поток-копировщик: забирает следующий кусок и копирует его через pread/pwrite
+static void *parallel_worker(void *arg) {
+    parallel_job_t *job = arg;
+    size_t buf_size = job->chunk_size < MAX_BUF_SIZE ? job->chunk_size : MAX_BUF_SIZE;
+    char *buf = malloc(buf_size);
+
+    while (1) {
+        pthread_mutex_lock(&job->m);
+        if (!buf && !job->error)
+            job->error = ENOMEM;
+        off_t idx = job->next_chunk++;
+        int stop = job->error != 0;
+        pthread_mutex_unlock(&job->m);
+
+        off_t off = idx * (off_t)job->chunk_size;
+        if (stop || off >= job->size)
+            break;
+
+        off_t len = job->size - off < (off_t)job->chunk_size ? job->size - off : (off_t)job->chunk_size;
+        off_t done;
+        int rc = copy_rw(job->fd_src, job->fd_dst, off, len, buf, buf_size, &done, NULL);
+        if (rc < 0 || done != len) {
+            int err = rc < 0 ? errno : EIO; // файл укоротился во время копирования
+            pthread_mutex_lock(&job->m);
+            if (!job->error)
+                job->error = err;
+            pthread_mutex_unlock(&job->m);
+            break;
+        }
+    }
+
+    free(buf);
+    return NULL;
+}
+
+// Параллельное копирование: файл режется на куски по chunk_size, потоки копируют их
+// по своим смещениям. Целевой файл заранее выделяется целиком, поэтому куски
+// могут записываться в любом порядке.
+static int copy_parallel(int fd_src, int fd_dst, const struct stat *st, const options_t *opt) {
+    parallel_job_t job = { fd_src, fd_dst, st->st_size,
+                           opt->chunk_size ? opt->chunk_size : DEFAULT_CHUNK, 0, 0,
+                           PTHREAD_MUTEX_INITIALIZER };
+    pthread_t tids[MAX_THREADS];
+    int n;
+
+    if (st->st_size == 0)
+        return 0;
+
+    // Резервируем место под весь файл; если ФС не умеет fallocate - хотя бы задаём размер
+    int rc = posix_fallocate(fd_dst, 0, st->st_size);
+    if (rc != 0 && ftruncate(fd_dst, st->st_size) < 0)
+        return -1;
+
+    for (n = 0; n < opt->threads; n++) {
+        if (pthread_create(&tids[n], NULL, parallel_worker, &job) != 0)
+            break;
+    }
+    // Если не создалось ни одного потока, копируем сами
+    if (n == 0)
+        parallel_worker(&job);
+    for (int i = 0; i < n; i++)
+        pthread_join(tids[i], NULL);
+    pthread_mutex_destroy(&job.m);
+
+    if (job.error) {
+        errno = job.error;
+        return -1;
+    }
+    return 0;
+}
+
+// Размер page cache всей системы (строка Cached в /proc/meminfo), КБ
+static long long meminfo_cached_kb(void) {
+    FILE *f = fopen("/proc/meminfo", "r");
+    char line[256];
+    long long kb = -1;
+    if (!f)
+        return -1;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "Cached: %lld kB", &kb) == 1)
+            break;
+    }
+    fclose(f);
+    return kb;
+}
+
+// Сколько страниц файла сейчас лежит в page cache (через mmap + mincore)
+static long long file_cached_pages(int fd) {
     struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+        return 0;
 
-    const char *src_path = argv[1]; // имя исходного файла
-    const char *dst_path = argv[2]; // имя целевого
+    long page = sysconf(_SC_PAGESIZE);
+    size_t pages = (st.st_size + page - 1) / page;
+    void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+        return -1;
+    unsigned char *vec = malloc(pages);
+    long long n = -1;
+    if (vec && mincore(addr, st.st_size, vec) == 0) {
+        n = 0;
+        for (size_t i = 0; i < pages; i++)
+            n += vec[i] & 1;
+    }
+    free(vec);
+    munmap(addr, st.st_size);
+    return n;
+}
 
-    fd_src = open(src_path, O_RDONLY); // исходный файл только для чтения
+// Копирование с O_DIRECT: чтение и запись идут мимо page cache выровненными блоками.
+// Последний неполный блок записывается целиком, а лишнее отрезается ftruncate.
+static int copy_direct(int fd_src, int fd_dst, const struct stat *st, const options_t *opt) {
+    int src_flags = fcntl(fd_src, F_GETFL);
+    int dst_flags = fcntl(fd_dst, F_GETFL);
 
-    fstat(fd_src, &st); // получаем права доступа
+    // tmpfs и некоторые другие ФС O_DIRECT не поддерживают - об этом скажет EINVAL
+    if (fcntl(fd_src, F_SETFL, src_flags | O_DIRECT) < 0)
+        return -1;
+    if (fcntl(fd_dst, F_SETFL, dst_flags | O_DIRECT) < 0) {
+        fcntl(fd_src, F_SETFL, src_flags);
+        return -1;
+    }
 
-    // открываем/создаём целевой файл для записи, очищаем старое содержимое
-    fd_dst = open(dst_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    size_t buf_size = choose_buf_size(st, opt);
+    buf_size = (buf_size + DIRECT_ALIGN - 1) / DIRECT_ALIGN * DIRECT_ALIGN;
+    char *buf = NULL;
+    int rc = -1;
+    if (posix_memalign((void **)&buf, DIRECT_ALIGN, buf_size) != 0) {
+        errno = ENOMEM;
+        goto out;
+    }
+
+    for (off_t off = 0; off < st->st_size; ) {
+        ssize_t nread = pread(fd_src, buf, buf_size, off);
+        if (nread < 0) {
+            if (errno == EINTR)
+                continue;
+            goto out;
+        }
+        if (nread == 0)
+            break;
+        // Хвост дополняем нулями до границы блока
+        size_t nwrite = ((size_t)nread + DIRECT_ALIGN - 1) / DIRECT_ALIGN * DIRECT_ALIGN;
+        memset(buf + nread, 0, nwrite - nread);
+        if (pwrite_all(fd_dst, buf, nwrite, off) < 0)
+            goto out;
+        off += nread;
+    }
+    rc = ftruncate(fd_dst, st->st_size);
+
+out:
+    free(buf);
+    fcntl(fd_src, F_SETFL, src_flags);
+    fcntl(fd_dst, F_SETFL, dst_flags);
+    return rc;
+}
+
+// Копирование через page cache, но с уборкой за собой: каждое окно dst отправляется
+// на запись (sync_file_range), а предыдущее окно дожидается записи и вместе с
+// прочитанной частью src выбрасывается из кэша (POSIX_FADV_DONTNEED).
+// Окна src, которые целиком были в кэше до чтения, не выбрасываются - их кто-то использует.
+static int copy_fadvise(int fd_src, int fd_dst, const struct stat *st, const options_t *opt) {
+    size_t buf_size = choose_buf_size(st, opt);
+    long page = sysconf(_SC_PAGESIZE);
+    char *buf = malloc(buf_size);
+    if (!buf)
+        return -1;
+
+    // Снимок того, какие страницы src были в кэше до копирования. Снимать его по ходу
+    // нельзя: опережающее чтение ядра подтягивает следующие окна заранее.
+    unsigned char *was_resident = NULL;
+    char *map = st->st_size ? mmap(NULL, st->st_size, PROT_READ, MAP_SHARED, fd_src, 0) : MAP_FAILED;
+    if (map != MAP_FAILED) {
+        was_resident = malloc((st->st_size + page - 1) / page);
+        if (was_resident && mincore(map, st->st_size, was_resident) < 0) {
+            free(was_resident);
+            was_resident = NULL;
+        }
+        munmap(map, st->st_size); // отображение нужно было только для mincore
+    }
+
+    posix_fadvise(fd_src, 0, 0, POSIX_FADV_SEQUENTIAL);
 
-    // читаем из исходного файла маленькими порциями до 32 байт
-    while ((nread = read(fd_src, buf, sizeof(buf))) > 0) {
-        ssize_t total_written = 0;
+    off_t off = 0, window_start = 0, prev_start = -1;
+    int rc = -1;
+    while (off < st->st_size) {
+        off_t len = st->st_size - off;
+        off_t done;
+        if (len > STREAM_WINDOW)
+            len = STREAM_WINDOW;
 
-        // записываем прочитанные байты в целевой файл, пока не запишем все nread байт
-        while (total_written < nread) {
-            ssize_t nw = write(fd_dst,
-                               buf + total_written,
-                               (size_t)(nread - total_written));
-            total_written += nw;
+        int was_cached = 0;
+        if (was_resident) {
+            off_t first = off / page, last = (off + len - 1) / page;
+            was_cached = 1;
+            for (off_t i = first; i <= last && was_cached; i++)
+                was_cached = was_resident[i] & 1;
         }
+
+        if (copy_rw(fd_src, fd_dst, off, len, buf, buf_size, &done, NULL) < 0)
+            goto out;
+        if (done == 0)
+            break;
+        off += done;
+
+        // Запускаем запись только что заполненного окна, не дожидаясь её
+        sync_file_range(fd_dst, window_start, off - window_start, SYNC_FILE_RANGE_WRITE);
+        // Предыдущее окно к этому моменту обычно уже записано - дожидаемся и выбрасываем
+        if (prev_start >= 0) {
+            sync_file_range(fd_dst, prev_start, window_start - prev_start,
+                            SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                            SYNC_FILE_RANGE_WAIT_AFTER);
+            posix_fadvise(fd_dst, prev_start, window_start - prev_start, POSIX_FADV_DONTNEED);
+        }
+        if (!was_cached)
+            posix_fadvise(fd_src, window_start, off - window_start, POSIX_FADV_DONTNEED);
+        prev_start = window_start;
+        window_start = off;
     }
+    if (prev_start >= 0) {
+        sync_file_range(fd_dst, prev_start, off - prev_start,
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                        SYNC_FILE_RANGE_WAIT_AFTER);
+        posix_fadvise(fd_dst, prev_start, off - prev_start, POSIX_FADV_DONTNEED);
+    }
+    rc = 0;
+
+out:
+    free(was_resident);
+    free(buf);
+    return rc;
+}
+
+// Дельта-копирование поверх старой версии dst: блоки src и dst сравниваются,
+// и записываются только отличающиеся. Оба файла локальные, поэтому блоки сравниваются
+// напрямую memcmp - это точнее хэшей и стоит столько же чтений.
+static int copy_delta(int fd_src, int fd_dst, const struct stat *st,
+                      const options_t *opt, copy_stats_t *stats) {
+    size_t block = opt->chunk_size ? opt->chunk_size : DELTA_BLOCK;
+    char *src_buf = malloc(block);
+    char *dst_buf = malloc(block);
+    int rc = -1;
+
+    stats->blocks = stats->changed_blocks = 0;
+    stats->copied = 0;
+    if (!src_buf || !dst_buf)
+        goto out;
+
+    struct stat st_dst;
+    if (fstat(fd_dst, &st_dst) < 0)
+        goto out;
+    posix_fadvise(fd_src, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(fd_dst, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    for (off_t off = 0; off < st->st_size; off += block) {
+        size_t len = st->st_size - off < (off_t)block ? (size_t)(st->st_size - off) : block;
+        if (pread_all(fd_src, src_buf, len, off) < 0)
+            goto out;
+        stats->blocks++;
+        // Весь src и так читается целиком, поэтому CRC32C (-k) считаем по каждому блоку
+        if (opt->checksum)
+            stats->crc = crc32c(stats->crc, src_buf, len);
+
+        // Блок, целиком лежащий в старом dst, читаем и сравниваем; за концом dst - просто пишем
+        if (off + (off_t)len <= st_dst.st_size) {
+            if (pread_all(fd_dst, dst_buf, len, off) < 0)
+                goto out;
+            if (memcmp(src_buf, dst_buf, len) == 0)
+                continue;
+        }
+        if (pwrite_all(fd_dst, src_buf, len, off) < 0)
+            goto out;
+        stats->changed_blocks++;
+        stats->copied += len;
+    }
+
+    // Старая версия могла быть длиннее
+    if (st_dst.st_size != st->st_size && ftruncate(fd_dst, st->st_size) < 0)
+        goto out;
+    stats->used = COPY_RW;
+    rc = 0;
+
+out:
+    free(src_buf);
+    free(dst_buf);
+    return rc;
+}
+
+// Заголовок журнала возобновляемого копирования. По нему проверяется, что журнал
+// относится к тому же исходному файлу и тому же размеру куска.
+typedef struct {
+    char magic[8];
+    long long size;           // Размер исходного файла
+    long long mtime_sec;      // Время изменения исходного файла
+    long long mtime_nsec;
+    long long chunk_size;     // Размер куска
+} journal_header_t;
 
-    fchmod(fd_dst, st.st_mode); // переносим права доступа
+// Запись журнала: кусок index целиком записан в dst и сброшен на диск
+typedef struct {
+    long long index;
+    uint32_t crc;             // CRC32C данных куска
+    uint32_t reserved;
+} journal_record_t;
 
-    fchown(fd_dst, st.st_uid, st.st_gid); // переносим владельца и группу (как у исходного файла)
+// Читает журнал и возвращает число подряд идущих зафиксированных кусков.
+// Если журнал пустой или от другого файла, он перезаписывается и возвращается 0.
+static long long journal_load(int fd_journal, const journal_header_t *hdr,
+                              journal_record_t **records) {
+    journal_header_t old;
+    long long n = 0, cap = 0;
+
+    *records = NULL;
+    if (pread(fd_journal, &old, sizeof(old), 0) == sizeof(old) &&
+        memcmp(&old, hdr, sizeof(old)) == 0) {
+        journal_record_t rec;
+        off_t pos = sizeof(old);
+        // Берём только непрерывный префикс; оборванная последняя запись отбрасывается
+        while (pread(fd_journal, &rec, sizeof(rec), pos) == sizeof(rec) && rec.index == n) {
+            if (n == cap) {
+                cap = cap ? cap * 2 : 256;
+                *records = realloc(*records, cap * sizeof(rec));
+            }
+            (*records)[n++] = rec;
+            pos += sizeof(rec);
+        }
+        return n;
+    }
+
+    if (ftruncate(fd_journal, 0) < 0 ||
+        pwrite(fd_journal, hdr, sizeof(*hdr), 0) != sizeof(*hdr) || fdatasync(fd_journal) < 0)
+        return -1;
+    return 0;
+}
+
+// Возобновляемое копирование кусками по chunk_size. После каждых journal_every кусков
+// данные dst сбрасываются на диск, и только потом в журнал дописываются номера и суммы
+// этих кусков. При повторном запуске хвост журнала сверяется с dst, и копирование
+// продолжается с первого куска, который не записан или не совпал по сумме.
+static int copy_resumable(int fd_src, int fd_dst, int fd_journal, const struct stat *st,
+                          const options_t *opt, copy_stats_t *stats) {
+    size_t chunk = opt->chunk_size ? opt->chunk_size : DEFAULT_CHUNK;
+    long long every = opt->journal_every > 0 ? opt->journal_every : JOURNAL_EVERY;
+    long long nchunks = (st->st_size + chunk - 1) / chunk;
+    journal_header_t hdr;
+    journal_record_t *records;
+    int rc = -1;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, JOURNAL_MAGIC, sizeof(hdr.magic));
+    hdr.size = st->st_size;
+    hdr.mtime_sec = st->st_mtim.tv_sec;
+    hdr.mtime_nsec = st->st_mtim.tv_nsec;
+    hdr.chunk_size = chunk;
+
+    long long committed = journal_load(fd_journal, &hdr, &records);
+    if (committed < 0)
+        return -1;
+
+    char *buf = malloc(chunk);
+    char *pending = malloc(every * sizeof(journal_record_t));
+    if (!buf || !pending)
+        goto out;
+
+    // Проверяем хвост: последние зафиксированные куски перечитываются из dst и
+    // сверяются с суммами из журнала. Первый несовпавший кусок и всё после него копируем заново.
+    long long start = committed;
+    for (long long i = committed - every > 0 ? committed - every : 0; i < committed; i++) {
+        off_t off = i * (off_t)chunk;
+        size_t len = st->st_size - off < (off_t)chunk ? (size_t)(st->st_size - off) : chunk;
+        if (pread_all(fd_dst, buf, len, off) < 0 || crc32c(0, buf, len) != records[i].crc) {
+            start = i;
+            break;
+        }
+    }
+    // Отбрасываем из журнала записи начиная с несовпавшего куска
+    if (start < committed &&
+        ftruncate(fd_journal, sizeof(hdr) + start * sizeof(journal_record_t)) < 0)
+        goto out;
+
+    // Сумма всего файла: уже скопированную часть берём из dst, она только что проверена
+    stats->crc = 0;
+    if (opt->checksum) {
+        for (long long i = 0; i < start; i++) {
+            off_t off = i * (off_t)chunk;
+            size_t len = st->st_size - off < (off_t)chunk ? (size_t)(st->st_size - off) : chunk;
+            if (pread_all(fd_dst, buf, len, off) < 0)
+                goto out;
+            stats->crc = crc32c(stats->crc, buf, len);
+        }
+    }
+    stats->resumed = start > 0 ? start * (long long)chunk : -1;
+
+    int npending = 0;
+    for (long long i = start; i < nchunks; i++) {
+        off_t off = i * (off_t)chunk;
+        off_t len = st->st_size - off < (off_t)chunk ? st->st_size - off : (off_t)chunk;
+
+        // Кусок читается целиком в буфер, чтобы посчитать его сумму до записи
+        if (pread_all(fd_src, buf, len, off) < 0 || pwrite_all(fd_dst, buf, len, off) < 0)
+            goto out;
+        uint32_t crc = crc32c(0, buf, len);
+        if (opt->checksum)
+            stats->crc = crc32c(stats->crc, buf, len);
+
+        journal_record_t rec = { i, crc, 0 };
+        memcpy(pending + npending * sizeof(rec), &rec, sizeof(rec));
+        npending++;
+
+        // Фиксация: сначала данные, потом журнал, чтобы журнал никогда не опережал dst
+        if (npending == every || i == nchunks - 1) {
+            off_t jpos = sizeof(hdr) + (i + 1 - npending) * sizeof(journal_record_t);
+            if (fdatasync(fd_dst) < 0 ||
+                pwrite(fd_journal, pending, npending * sizeof(rec), jpos) != (ssize_t)(npending * sizeof(rec)) ||
+                fdatasync(fd_journal) < 0)
+                goto out;
+            npending = 0;
+        }
+    }
+
+    // dst мог остаться длиннее от прошлой версии - обрезаем по исходному
+    if (ftruncate(fd_dst, st->st_size) < 0)
+        goto out;
+    stats->used = COPY_RW;
+    stats->copied = (st->st_size - (start > 0 ? start * (long long)chunk : 0));
+    rc = 0;
+
+out:
+    free(buf);
+    free(pending);
+    free(records);
+    return rc;
+}
+
+// Копирует содержимое открытого файла и переносит права и владельца.
+// fd_journal - журнал для режима -R, иначе -1.
+static int copy_fd(int fd_src, int fd_dst, int fd_journal, const struct stat *st,
+                   const options_t *opt, copy_stats_t *stats) {
+    double start = now_sec();
+    stats->crc = 0;
+    stats->resumed = -1;
+    stats->stream_used = STREAM_NONE;
+
+    // Для обычных файлов размер известен, для каналов и устройств копируем до EOF.
+    // Файлы /proc и /sys обычные, но с нулевым размером, - их тоже читаем до EOF
+    off_t len = S_ISREG(st->st_mode) && st->st_size > 0 ? st->st_size : -1;
+    if (opt->stream && len >= 0) {
+        stats->cache_before = meminfo_cached_kb();
+        stats->src_pages_before = file_cached_pages(fd_src);
+    }
+
+    if (opt->stream && len >= 0 && !opt->checksum) {
+        int rc = -1;
+        stats->stream_used = opt->stream;
+        if (opt->stream == STREAM_DIRECT)
+            rc = copy_direct(fd_src, fd_dst, st, opt);
+        // Если O_DIRECT не поддерживается, убираем за собой через fadvise
+        if (rc < 0 && (opt->stream == STREAM_FADVISE || errno == EINVAL)) {
+            stats->stream_used = STREAM_FADVISE;
+            rc = copy_fadvise(fd_src, fd_dst, st, opt);
+        }
+        if (rc < 0)
+            return -1;
+        stats->used = COPY_RW;
+        stats->copied = -1;
+    } else if (opt->delta && len >= 0) {
+        if (copy_delta(fd_src, fd_dst, st, opt, stats) < 0)
+            return -1;
+    } else if (fd_journal >= 0 && len >= 0) {
+        if (copy_resumable(fd_src, fd_dst, fd_journal, st, opt, stats) < 0)
+            return -1;
+    } else if (opt->sparse && len >= 0) {
+        if (copy_sparse(fd_src, fd_dst, st, opt, stats) < 0)
+            return -1;
+    } else if (opt->threads > 1 && len >= 0 && !opt->checksum) {
+        if (copy_parallel(fd_src, fd_dst, st, opt) < 0)
+            return -1;
+        stats->used = COPY_RW;
+        stats->copied = -1;
+    } else {
+        if (copy_range(fd_src, fd_dst, 0, len, st, opt, &stats->used,
+                       opt->checksum ? &stats->crc : NULL) < 0)
+            return -1;
+        stats->copied = -1;
+    }
+
+    fchmod(fd_dst, st->st_mode); // переносим права доступа
+
+    // переносим владельца и группу (как у исходного файла); без прав root это может не получиться
+    if (fchown(fd_dst, st->st_uid, st->st_gid) < 0 && errno != EPERM)
+        perror("fchown");
+
+    // время доступа и изменения (в режиме копирования дерева)
+    if (opt->keep_times) {
+        struct timespec times[2] = { st->st_atim, st->st_mtim };
+        futimens(fd_dst, times);
+    }
+
+    struct stat st_dst;
+    fstat(fd_dst, &st_dst);
+    stats->bytes = st_dst.st_size;
+    stats->allocated = (long long)st_dst.st_blocks * 512;
+    if (stats->copied < 0)
+        stats->copied = stats->bytes;
+    stats->seconds = now_sec() - start;
+
+    if (opt->stream && len >= 0) {
+        stats->cache_after = meminfo_cached_kb();
+        stats->src_pages_after = file_cached_pages(fd_src);
+        stats->dst_pages_after = file_cached_pages(fd_dst);
+    }
+    return 0;
+}
+
+// Читает контрольную сумму из файла path.crc32c (формат как у sha256sum: "сумма  имя")
+static int read_sidecar(const char *path, uint32_t *crc) {
+    char name[PATH_MAX];
+    if (snprintf(name, sizeof(name), "%s.crc32c", path) >= (int)sizeof(name))
+        return -1;
+    FILE *f = fopen(name, "r");
+    if (!f)
+        return -1;
+    unsigned int value;
+    int ok = fscanf(f, "%8x", &value) == 1;
+    fclose(f);
+    if (!ok)
+        return -1;
+    *crc = value;
+    return 0;
+}
+
+// Записывает контрольную сумму в файл path.crc32c
+static int write_sidecar(const char *path, uint32_t crc) {
+    char name[PATH_MAX];
+    if (snprintf(name, sizeof(name), "%s.crc32c", path) >= (int)sizeof(name))
+        return -1;
+    FILE *f = fopen(name, "w");
+    if (!f)
+        return -1;
+    const char *base = strrchr(path, '/');
+    fprintf(f, "%08x  %s\n", crc, base ? base + 1 : path);
+    return fclose(f);
+}
+
+// Открывает оба файла по путям и копирует
+static int copy_file(const char *src_path, const char *dst_path,
+                     const options_t *opt, copy_stats_t *stats) {
+    struct stat st;
+
+    int fd_src = open(src_path, O_RDONLY); // исходный файл только для чтения
+    if (fd_src < 0) {
+        perror(src_path);
+        return -1;
+    }
+    // получаем права доступа
+    if (fstat(fd_src, &st) < 0) {
+        perror(src_path);
+        close(fd_src);
+        return -1;
+    }
+
+    // В режимах -R и -d старое содержимое dst нужно, поэтому без O_TRUNC
+    int resume = opt->resume && S_ISREG(st.st_mode);
+    int keep_old = resume || (opt->delta && S_ISREG(st.st_mode));
+    char journal_path[PATH_MAX];
+    int fd_journal = -1;
+
+    // открываем/создаём целевой файл для записи, очищаем старое содержимое
+    // (в режиме -S dst открывается и на чтение, чтобы посчитать его страницы в кэше)
+    int dst_flags = keep_old ? O_RDWR | O_CREAT : O_CREAT | O_TRUNC | (opt->stream ? O_RDWR : O_WRONLY);
+    int fd_dst = open(dst_path, dst_flags, 0600);
+    if (fd_dst < 0) {
+        perror(dst_path);
+        close(fd_src);
+        return -1;
+    }
+
+    if (resume) {
+        if (snprintf(journal_path, sizeof(journal_path), "%s.journal", dst_path) >= (int)sizeof(journal_path) ||
+            (fd_journal = open(journal_path, O_RDWR | O_CREAT, 0600)) < 0) {
+            perror(journal_path);
+            close(fd_src);
+            close(fd_dst);
+            return -1;
+        }
+    }
+
+    int rc = copy_fd(fd_src, fd_dst, fd_journal, &st, opt, stats);
+    if (rc < 0)
+        fprintf(stderr, "%s: %s\n", src_path, strerror(errno));
+
+    // Копирование завершено - журнал больше не нужен; при ошибке он остаётся для продолжения
+    if (fd_journal >= 0) {
+        close(fd_journal);
+        if (rc == 0)
+            unlink(journal_path);
+    }
+
+    // Сумма посчитана по потоку данных во время копирования, файлы повторно не читаются
+    if (rc == 0 && opt->write_sum && write_sidecar(dst_path, stats->crc) < 0) {
+        fprintf(stderr, "%s.crc32c: %s\n", dst_path, strerror(errno));
+        rc = -1;
+    }
+    if (rc == 0 && opt->verify_sum) {
+        uint32_t expected;
+        if (read_sidecar(src_path, &expected) < 0) {
+            fprintf(stderr, "%s.crc32c: не удалось прочитать контрольную сумму\n", src_path);
+            rc = -1;
+        } else if (expected != stats->crc) {
+            fprintf(stderr, "%s: контрольная сумма не совпала: ожидалось %08x, получено %08x\n",
+                    src_path, expected, stats->crc);
+            rc = -1;
+        }
+    }
 
     // закрываем оба файловых дескриптора
     close(fd_src);
-    close(fd_dst);
+    if (close(fd_dst) < 0) {
+        perror(dst_path);
+        rc = -1;
+    }
+    return rc;
+}
 
-    return 0;
+// Файл, ожидающий копирования в режиме -r
+typedef struct {
+    char *src;
+    char *dst;
+} tree_task_t;
+
+// Каталог, которому после копирования содержимого нужно вернуть права и время
+typedef struct {
+    char *path;
+    struct stat st;
+} tree_dir_t;
+
+// Состояние копирования дерева: ограниченная очередь файлов и общие счётчики
+typedef struct {
+    const options_t *opt;      // Параметры для копирования отдельных файлов
+    tree_task_t queue[TREE_QUEUE_SIZE];
+    int head, count;           // Начало очереди и число файлов в ней
+    int closed;                // Обход закончен, новых файлов не будет
+    pthread_mutex_t m;
+    pthread_cond_t not_empty;  // В очереди появился файл
+    pthread_cond_t not_full;   // В очереди освободилось место
+
+    tree_dir_t *dirs;          // Каталоги в порядке завершения обхода (вложенные раньше внешних)
+    int ndirs, dirs_cap;
+
+    long long files, links, bytes;
+    int errors;
+} tree_t;
+
+// Выставляет владельца, права и время уже созданному объекту (без перехода по ссылке)
+static void apply_attrs(const char *path, const struct stat *st, int keep_mode) {
+    if (fchownat(AT_FDCWD, path, st->st_uid, st->st_gid, AT_SYMLINK_NOFOLLOW) < 0 && errno != EPERM)
+        perror(path);
+    if (keep_mode)
+        chmod(path, st->st_mode & 07777);
+    struct timespec times[2] = { st->st_atim, st->st_mtim };
+    utimensat(AT_FDCWD, path, times, AT_SYMLINK_NOFOLLOW);
+}
+
+// Поток-копировщик дерева: берёт файлы из очереди, пока обход не закончится
+static void *tree_worker(void *arg) {
+    tree_t *t = arg;
+
+    while (1) {
+        pthread_mutex_lock(&t->m);
+        while (t->count == 0 && !t->closed)
+            pthread_cond_wait(&t->not_empty, &t->m);
+        if (t->count == 0) {
+            pthread_mutex_unlock(&t->m);
+            break;
+        }
+        tree_task_t task = t->queue[t->head];
+        t->head = (t->head + 1) % TREE_QUEUE_SIZE;
+        t->count--;
+        pthread_cond_signal(&t->not_full);
+        pthread_mutex_unlock(&t->m);
+
+        copy_stats_t stats;
+        int rc = copy_file(task.src, task.dst, t->opt, &stats);
+
+        pthread_mutex_lock(&t->m);
+        if (rc < 0) {
+            t->errors++;
+        } else {
+            t->files++;
+            t->bytes += stats.bytes;
+        }
+        pthread_mutex_unlock(&t->m);
+
+        free(task.src);
+        free(task.dst);
+    }
+    return NULL;
+}
+
+// Кладёт файл в очередь, ожидая, если она заполнена
+static void tree_push(tree_t *t, const char *src, const char *dst) {
+    pthread_mutex_lock(&t->m);
+    while (t->count == TREE_QUEUE_SIZE)
+        pthread_cond_wait(&t->not_full, &t->m);
+    tree_task_t *task = &t->queue[(t->head + t->count) % TREE_QUEUE_SIZE];
+    task->src = strdup(src);
+    task->dst = strdup(dst);
+    t->count++;
+    pthread_cond_signal(&t->not_empty);
+    pthread_mutex_unlock(&t->m);
+}
+
+static void tree_error(tree_t *t, const char *path) {
+    perror(path);
+    pthread_mutex_lock(&t->m);
+    t->errors++;
+    pthread_mutex_unlock(&t->m);
+}
+
+// Обход каталога src: подкаталоги создаются сразу в порядке обхода, ссылки и
+// специальные файлы - тоже, а обычные файлы отдаются в очередь потокам
+static void tree_walk(tree_t *t, const char *src, const char *dst, const struct stat *st) {
+    // Создаём каталог с правами на запись для себя, настоящие права выставим в конце
+    if (mkdir(dst, 0700) < 0 && errno != EEXIST) {
+        tree_error(t, dst);
+        return;
+    }
+
+    DIR *dir = opendir(src);
+    if (!dir) {
+        tree_error(t, src);
+        return;
+    }
+
+    // Буферы путей на куче: функция рекурсивна, и три массива PATH_MAX на стеке
+    // на каждый уровень вложенности быстро исчерпали бы стек потока
+    char *src_path = malloc(3 * PATH_MAX);
+    if (!src_path) {
+        tree_error(t, src);
+        closedir(dir);
+        return;
+    }
+    char *dst_path = src_path + PATH_MAX;
+    char *target = dst_path + PATH_MAX;
+
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL) {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+            continue;
+        if (snprintf(src_path, PATH_MAX, "%s/%s", src, de->d_name) >= PATH_MAX ||
+            snprintf(dst_path, PATH_MAX, "%s/%s", dst, de->d_name) >= PATH_MAX) {
+            errno = ENAMETOOLONG;
+            tree_error(t, src_path);
+            continue;
+        }
+
+        struct stat est;
+        if (fstatat(dirfd(dir), de->d_name, &est, AT_SYMLINK_NOFOLLOW) < 0) {
+            tree_error(t, src_path);
+            continue;
+        }
+
+        if (S_ISDIR(est.st_mode)) {
+            tree_walk(t, src_path, dst_path, &est);
+        } else if (S_ISREG(est.st_mode)) {
+            tree_push(t, src_path, dst_path);
+        } else if (S_ISLNK(est.st_mode)) {
+            // Ссылку копируем как ссылку, с тем же текстом
+            ssize_t n = readlink(src_path, target, PATH_MAX - 1);
+            if (n < 0) {
+                tree_error(t, src_path);
+                continue;
+            }
+            target[n] = '\0';
+            if (symlink(target, dst_path) < 0) {
+                tree_error(t, dst_path);
+                continue;
+            }
+            apply_attrs(dst_path, &est, 0);
+            pthread_mutex_lock(&t->m);
+            t->links++;
+            pthread_mutex_unlock(&t->m);
+        } else {
+            // Каналы, сокеты и устройства создаём заново
+            if (mknod(dst_path, est.st_mode, est.st_rdev) < 0) {
+                tree_error(t, dst_path);
+                continue;
+            }
+            apply_attrs(dst_path, &est, 1);
+        }
+    }
+    closedir(dir);
+    free(src_path);
+
+    // Права и время каталога выставляются после того, как в него запишут все файлы
+    if (t->ndirs == t->dirs_cap) {
+        int cap = t->dirs_cap ? t->dirs_cap * 2 : 64;
+        tree_dir_t *dirs = realloc(t->dirs, cap * sizeof(tree_dir_t));
+        if (!dirs) {
+            tree_error(t, dst);
+            return;
+        }
+        t->dirs = dirs;
+        t->dirs_cap = cap;
+    }
+    char *path = strdup(dst);
+    if (!path) {
+        tree_error(t, dst);
+        return;
+    }
+    t->dirs[t->ndirs].path = path;
+    t->dirs[t->ndirs].st = *st;
+    t->ndirs++;
 }
 
+// Копирование дерева каталогов src в dst пулом из workers потоков
+static int copy_tree(const char *src, const char *dst, const options_t *opt, int workers) {
+    struct stat st;
+    if (lstat(src, &st) < 0) {
+        perror(src);
+        return -1;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        fprintf(stderr, "%s: не каталог\n", src);
+        return -1;
+    }
+
+    // Отдельные файлы копируются одним потоком, параллельность - на уровне файлов
+    options_t file_opt = *opt;
+    file_opt.threads = 1;
+    file_opt.keep_times = 1;
+
+    tree_t t;
+    memset(&t, 0, sizeof(t));
+    t.opt = &file_opt;
+    pthread_mutex_init(&t.m, NULL);
+    pthread_cond_init(&t.not_empty, NULL);
+    pthread_cond_init(&t.not_full, NULL);
+
+    double start = now_sec();
+    pthread_t tids[MAX_THREADS];
+    int n;
+    for (n = 0; n < workers; n++) {
+        if (pthread_create(&tids[n], NULL, tree_worker, &t) != 0)
+            break;
+    }
+    if (n == 0) {
+        perror("pthread_create");
+        return -1;
+    }
+
+    tree_walk(&t, src, dst, &st);
+
+    // Обход закончен - будим потоки, чтобы они разобрали остаток очереди и вышли
+    pthread_mutex_lock(&t.m);
+    t.closed = 1;
+    pthread_cond_broadcast(&t.not_empty);
+    pthread_mutex_unlock(&t.m);
+    for (int i = 0; i < n; i++)
+        pthread_join(tids[i], NULL);
+
+    // Вложенные каталоги стоят в списке раньше внешних, поэтому время внешнего
+    // не собьётся при изменении вложенного
+    for (int i = 0; i < t.ndirs; i++) {
+        apply_attrs(t.dirs[i].path, &t.dirs[i].st, 1);
+        free(t.dirs[i].path);
+    }
+    free(t.dirs);
+
+    double seconds = now_sec() - start;
+    if (!opt->quiet) {
+        printf("Файлов: %lld, каталогов: %d, ссылок: %lld, ошибок: %d, потоков: %d\n",
+               t.files, t.ndirs, t.links, t.errors, n);
+        printf("Скопировано %lld байт за %.3f с (%.1f МБ/с, %.0f файлов/с)\n",
+               t.bytes, seconds, seconds > 0 ? t.bytes / (1024.0 * 1024.0) / seconds : 0,
+               seconds > 0 ? t.files / seconds : 0);
+    }
+
+    pthread_mutex_destroy(&t.m);
+    pthread_cond_destroy(&t.not_empty);
+    pthread_cond_destroy(&t.not_full);
+    return t.errors ? -1 : 0;
+}
+
+// Кэш дескрипторов каталогов для пакетного режима: файлы из одного каталога
+// открываются через openat, и путь до каталога не разбирается ядром каждый раз
+typedef struct {
+    char *path;
+    int fd;
+} dir_cache_entry_t;
+
+static unsigned hash_str(const char *str) {
+    unsigned h = 5381;
+    while (*str)
+        h = h * 33 + (unsigned char)*str++;
+    return h;
+}
+
+// Возвращает дескриптор каталога dir, открывая его при промахе
+static int dir_cache_get(dir_cache_entry_t *cache, const char *dir) {
+    dir_cache_entry_t *e = &cache[hash_str(dir) % DIR_CACHE_SIZE];
+    if (e->path && strcmp(e->path, dir) == 0)
+        return e->fd;
+
+    int fd = open(dir, O_PATH | O_DIRECTORY);
+    if (fd < 0)
+        return -1;
+    if (e->path) {
+        close(e->fd);
+        free(e->path);
+    }
+    e->path = strdup(dir);
+    e->fd = fd;
+    return fd;
+}
+
+// Делит путь на дескриптор каталога (из кэша) и имя файла в нём
+static int split_path(dir_cache_entry_t *cache, char *path, const char **name) {
+    char *slash = strrchr(path, '/');
+    if (!slash) {
+        *name = path;
+        return AT_FDCWD;
+    }
+    *name = slash + 1;
+    if (slash == path)
+        return dir_cache_get(cache, "/");
+    *slash = '\0';
+    int fd = dir_cache_get(cache, path);
+    *slash = '/';
+    return fd;
+}
+
+// Копирует одну пару из списка через openat относительно закэшированных каталогов
+static int batch_copy_one(dir_cache_entry_t *cache, char *src, char *dst,
+                          const options_t *opt, copy_stats_t *stats) {
+    const char *src_name, *dst_name;
+    struct stat st;
+
+    // Источник открываем до поиска каталога приемника: оба каталога могут попасть
+    // в одну ячейку кэша, и поиск приемника закроет дескриптор каталога источника
+    int dfd_src = split_path(cache, src, &src_name);
+    if (dfd_src == -1) {
+        perror(src);
+        return -1;
+    }
+    int fd_src = openat(dfd_src, src_name, O_RDONLY);
+    if (fd_src < 0) {
+        perror(src);
+        return -1;
+    }
+    if (fstat(fd_src, &st) < 0) {
+        perror(src);
+        close(fd_src);
+        return -1;
+    }
+
+    int dfd_dst = split_path(cache, dst, &dst_name);
+    if (dfd_dst == -1) {
+        perror(dst);
+        close(fd_src);
+        return -1;
+    }
+    int fd_dst = openat(dfd_dst, dst_name, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd_dst < 0) {
+        perror(dst);
+        close(fd_src);
+        return -1;
+    }
+
+    int rc = copy_fd(fd_src, fd_dst, -1, &st, opt, stats);
+    if (rc < 0)
+        fprintf(stderr, "%s: %s\n", src, strerror(errno));
+    close(fd_src);
+    if (close(fd_dst) < 0) {
+        perror(dst);
+        rc = -1;
+    }
+    return rc;
+}
+
+// Пакетный режим: пары "src<TAB>dst" (или через пробел, если в путях нет пробелов)
+// читаются построчно из manifest и копируются в одном процессе
+static int copy_batch(const options_t *opt) {
+    FILE *f = strcmp(opt->manifest, "-") == 0 ? stdin : fopen(opt->manifest, "r");
+    if (!f) {
+        perror(opt->manifest);
+        return -1;
+    }
+
+    dir_cache_entry_t cache[DIR_CACHE_SIZE];
+    memset(cache, 0, sizeof(cache));
+
+    // Режимы, которым нужны пути (журнал, файлы сумм, старая версия dst), идут через copy_file
+    int by_path = opt->resume || opt->write_sum || opt->verify_sum || opt->delta || opt->stream;
+
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t n;
+    long long files = 0, bytes = 0, lineno = 0;
+    int errors = 0;
+    double start = now_sec();
+
+    while ((n = getline(&line, &cap, f)) > 0) {
+        lineno++;
+        if (line[n - 1] == '\n')
+            line[--n] = '\0';
+        if (n == 0 || line[0] == '#')
+            continue;
+
+        char *sep = strchr(line, '\t');
+        if (!sep)
+            sep = strchr(line, ' ');
+        if (!sep || sep == line || sep[1] == '\0') {
+            fprintf(stderr, "%s:%lld: ожидалось \"src<TAB>dst\"\n", opt->manifest, lineno);
+            errors++;
+            continue;
+        }
+        *sep = '\0';
+        char *src = line, *dst = sep + 1;
+
+        copy_stats_t stats;
+        int rc = by_path ? copy_file(src, dst, opt, &stats)
+                         : batch_copy_one(cache, src, dst, opt, &stats);
+        if (rc < 0) {
+            errors++;
+        } else {
+            files++;
+            bytes += stats.bytes;
+        }
+    }
+
+    double seconds = now_sec() - start;
+    if (!opt->quiet) {
+        printf("Файлов: %lld, ошибок: %d, байт: %lld за %.3f с\n", files, errors, bytes, seconds);
+        printf("Скорость: %.0f файлов/с, %.1f МБ/с\n", seconds > 0 ? files / seconds : 0,
+               seconds > 0 ? bytes / (1024.0 * 1024.0) / seconds : 0);
+    }
+
+    for (int i = 0; i < DIR_CACHE_SIZE; i++) {
+        if (cache[i].path) {
+            close(cache[i].fd);
+            free(cache[i].path);
+        }
+    }
+    free(line);
+    if (f != stdin)
+        fclose(f);
+    return errors ? -1 : 0;
+}
+
+// Печать отчёта: способ и скорость
+static void print_stats(const copy_stats_t *stats, const options_t *opt) {
+    double mb = stats->copied / (1024.0 * 1024.0);
+    double speed = stats->seconds > 0 ? mb / stats->seconds : 0;
+    printf("Способ: %s, скопировано %lld байт за %.3f с (%.1f МБ/с)\n",
+           method_names[stats->used], stats->bytes, stats->seconds, speed);
+    if (opt->threads > 1 && !opt->sparse && !opt->checksum)
+        printf("Параллельно: %d потоков, кусок %zu байт\n", opt->threads,
+               opt->chunk_size ? opt->chunk_size : (size_t)DEFAULT_CHUNK);
+    if (opt->stream && stats->stream_used) {
+        printf("Режим -S: %s\n", stats->stream_used == STREAM_DIRECT ? "O_DIRECT" : "fadvise + sync_file_range");
+        printf("Page cache: было %lld КБ, стало %lld КБ; страниц src в кэше: %lld -> %lld, dst: %lld\n",
+               stats->cache_before, stats->cache_after, stats->src_pages_before,
+               stats->src_pages_after, stats->dst_pages_after);
+    }
+    if (opt->delta && stats->blocks)
+        printf("Изменено блоков: %lld из %lld\n", stats->changed_blocks, stats->blocks);
+    if (stats->resumed >= 0)
+        printf("Продолжено по журналу с байта %lld\n", stats->resumed);
+    if (opt->checksum)
+        printf("CRC32C: %08x\n", stats->crc);
+    if (stats->copied != stats->bytes)
+        printf("Данных перенесено: %lld байт, занято на диске: %lld байт\n",
+               stats->copied, stats->allocated);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Использование: %s [-m auto|cfr|sendfile|rw|uring|mmap] [-b размер_буфера] [-s]\n"
+            "          [-j потоки] [-c размер_куска] [-u глубина_очереди] [-r]\n"
+            "          [-k] [-w] [-v] [-R] [-J кусков] [-S direct|fadvise] [-d] [-q] src dst\n"
+            "       %s [ключи] -B список|-\n",
+            prog, prog);
+}
+
+int main(int argc, char *argv[])
+{
+    options_t opt = { COPY_AUTO, 0, 0, 0, 1, 0, URING_DEPTH, 0, 0, 0, 0, 0, 0, JOURNAL_EVERY, STREAM_NONE, 0, NULL };
+    int c;
+
+    while ((c = getopt(argc, argv, "m:b:sj:c:u:rkwvRJ:S:dB:q")) != -1) {
+        switch (c) {
+        case 'm':
+            if (strcmp(optarg, "auto") == 0)          opt.method = COPY_AUTO;
+            else if (strcmp(optarg, "cfr") == 0)      opt.method = COPY_CFR;
+            else if (strcmp(optarg, "sendfile") == 0) opt.method = COPY_SENDFILE;
+            else if (strcmp(optarg, "rw") == 0)       opt.method = COPY_RW;
+            else if (strcmp(optarg, "uring") == 0)    opt.method = COPY_URING;
+            else if (strcmp(optarg, "mmap") == 0)     opt.method = COPY_MMAP;
+            else {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'b':
+            opt.buf_size = strtoull(optarg, NULL, 0);
+            break;
+        case 'q':
+            opt.quiet = 1;
+            break;
+        case 's':
+            opt.sparse = 1;
+            break;
+        case 'j':
+            opt.threads = atoi(optarg);
+            if (opt.threads < 1)
+                opt.threads = 1;
+            if (opt.threads > MAX_THREADS)
+                opt.threads = MAX_THREADS;
+            break;
+        case 'c':
+            opt.chunk_size = strtoull(optarg, NULL, 0);
+            break;
+        case 'u':
+            opt.method = COPY_URING;
+            opt.uring_depth = atoi(optarg);
+            break;
+        case 'r':
+            opt.recursive = 1;
+            break;
+        case 'k':
+            opt.checksum = 1;
+            break;
+        case 'w':
+            opt.checksum = opt.write_sum = 1;
+            break;
+        case 'v':
+            opt.checksum = opt.verify_sum = 1;
+            break;
+        case 'R':
+            opt.resume = 1;
+            break;
+        case 'J':
+            opt.journal_every = atoi(optarg);
+            break;
+        case 'd':
+            opt.delta = 1;
+            break;
+        case 'B':
+            opt.manifest = optarg;
+            break;
+        case 'S':
+            if (strcmp(optarg, "direct") == 0)       opt.stream = STREAM_DIRECT;
+            else if (strcmp(optarg, "fadvise") == 0) opt.stream = STREAM_FADVISE;
+            else {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // Контрольная сумма считается только при копировании через буфер процесса,
+    // поэтому -S и параллельное копирование файла (-j без -r) с ней не работают
+    if (opt.checksum && opt.stream)
+        fprintf(stderr, "Предупреждение: с -k/-w/-v режим -S не используется\n");
+    if (opt.checksum && opt.threads > 1 && !opt.recursive)
+        fprintf(stderr, "Предупреждение: с -k/-w/-v файл копируется в один поток, -j не используется\n");
+    // Режим -S сам выбирает, как копировать, и вытесняет -R/-d/-s. Отключаем их сразу,
+    // чтобы, например, не создавать журнал, который никто не заполнит
+    if (opt.stream && !opt.checksum && (opt.resume || opt.delta || opt.sparse)) {
+        fprintf(stderr, "Предупреждение: с -S режимы -R/-d/-s не используются\n");
+        opt.resume = opt.delta = opt.sparse = 0;
+    }
+
+    // Пакетный режим: пары файлов берутся из списка, а не из аргументов
+    if (opt.manifest) {
+        if (argc != optind) {
+            usage(argv[0]);
+            return 1;
+        }
+        return copy_batch(&opt) < 0 ? 1 : 0;
+    }
+
+    if (argc - optind != 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const char *src_path = argv[optind];     // имя исходного файла
+    const char *dst_path = argv[optind + 1]; // имя целевого
+
+    // Дерево копируем пулом потоков: -j или по числу процессоров
+    if (opt.recursive) {
+        int workers = opt.threads > 1 ? opt.threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+        if (workers < 1)
+            workers = 1;
+        if (workers > MAX_THREADS)
+            workers = MAX_THREADS;
+        return copy_tree(src_path, dst_path, &opt, workers) < 0 ? 1 : 0;
+    }
+
+    copy_stats_t stats;
+    if (copy_file(src_path, dst_path, &opt, &stats) < 0)
+        return 1;
+
+    if (!opt.quiet)
+        print_stats(&stats, &opt);
+
+    return 0;
+}
@@ -1,118 +1,276 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
 #include <pthread.h>
 #include <unistd.h>
 #include <time.h>
 
 // Глобальные переменные
-int buffer[200]; // Буфер
-int count = 0; // Кол-во чисел в буфере
-int active_src = 100; // Активные источники
-int active_add = 0; // Активные суматоры
+int64_t *buffer = NULL; // Буфер (растет по мере надобности)
+long capacity = 0; // Размер выделенного буфера
+long count = 0; // Кол-во чисел в буфере
+long long active_src = 100; // Сколько чисел еще не поступило от источников
+long active_add = 0; // Активные суматоры (задачи в очереди и в работе)
+int overflow = 0; // Сумма вышла за пределы int64
+int64_t src_sum = 0; // Сумма поступивших чисел - для проверки итога
+int src_overflow = 0; // Сумма поступивших чисел вышла за пределы int64
+int src_waiting = 0; // Источники ждут места в буфере
+
+// Параметры
+long long sources = 100; // Кол-во источников
+long producers = 0; // Кол-во потоков-источников
+long limit = 1 << 20; // Больше чисел в буфере источники не кладут, а ждут сумматоры
+int delay_pct = 100; // Задержки в процентах от исходных (0 - без задержек)
+int64_t max_value = 100; // Источники дают числа от 1 до max_value
+int quiet = 0; // Не печатать каждое событие
+
+// Задача сумматора - пара чисел
+typedef struct {
+    int64_t a, b;
+} task_t;
+
+// Очередь задач для пула сумматоров (кольцевая). Пока она заполнена, пары остаются
+// в буфере, поэтому ее размер зависит только от размера пула
+task_t *tasks;
+long task_cap; // Размер очереди
+long task_head = 0; // Откуда сумматор берет следующую задачу
+long task_count = 0; // Кол-во задач в очереди
+int stop = 0; // Вычисление закончено, сумматоры завершаются
 
 pthread_mutex_t m; // Мьютекс
 pthread_cond_t c; // Оповещение основного потока
+pthread_cond_t task_c; // Оповещение сумматоров о новой задаче
+pthread_cond_t space_c; // Оповещение источников о месте в буфере
+
+// Задержка в sec секунд с учетом delay_pct
+void delay(int sec) {
+    long ms = sec * 10L * delay_pct;
+    if(ms > 0) {
+        struct timespec ts = { ms / 1000, ms % 1000 * 1000000 };
+        nanosleep(&ts, NULL);
+    }
+}
+
+// Положить число в буфер (под мьютексом). Буфер растет вдвое, когда заполнен,
+// поэтому память пропорциональна числам в обработке, а не числу источников
+void push_value(int64_t val) {
+    if(count == capacity) {
+        long new_capacity = capacity ? capacity * 2 : 256;
+        int64_t *p = realloc(buffer, new_capacity * sizeof(int64_t));
+        if(!p) {
+            perror("realloc");
+            exit(1);
+        }
+        buffer = p;
+        capacity = new_capacity;
+    }
+    buffer[count++] = val;
+}
 
-// Поток-источник
+// Поток-источник: выдает числа источников id, id + producers, id + 2 * producers, ...
+// Отдельный поток на каждый источник при миллионах источников не создать
 void* source(void* arg) {
-    long id = (long)arg; // ID потока
-    unsigned int seed = time(NULL) ^ id; // Уникальный сид
+    long long first = (long)arg; // ID первого источника потока
+    unsigned int seed = time(NULL) ^ first; // Уникальный сид
 
-    // Задержка от 1 до 7 секунд
-    sleep(1 + rand_r(&seed) % 7);
-    // Случайного числа от 1 до 100
-    int val = 1 + rand_r(&seed) % 100;
+    for(long long id = first; id <= sources; id += producers) {
+        // Задержка от 1 до 7 секунд
+        delay(1 + rand_r(&seed) % 7);
+        // Случайное число от 1 до max_value (rand_r дает 31 бит, склеиваем три вызова)
+        uint64_t r = (uint64_t)rand_r(&seed) << 33 ^ (uint64_t)rand_r(&seed) << 16 ^ rand_r(&seed);
+        int64_t val = 1 + r % max_value;
 
-    // Блокируем доступ к общим данным перед записью
-    pthread_mutex_lock(&m);
+        // Блокируем доступ к общим данным перед записью
+        pthread_mutex_lock(&m);
 
-    buffer[count++] = val; // Кладем число в буфер
-    active_src--;          // Уменьшаем счетчик оставшихся источников
+        // Буфер заполнен - ждем, пока сумматоры разберут его наполовину
+        while(count >= limit) {
+            src_waiting = 1;
+            pthread_cond_wait(&space_c, &m);
+        }
 
-    // Выводим информацию в консоль
-    printf("[Источник %3ld] Поступило: %d. (В буфере: %d)\n", id, val, count);
+        push_value(val); // Кладем число в буфер
+        active_src--;    // Уменьшаем счетчик оставшихся чисел
+        if(__builtin_add_overflow(src_sum, val, &src_sum))
+            src_overflow = 1;
 
-    // Сигнал главному потоку, что появились данные
-    pthread_cond_signal(&c);
+        // Выводим информацию в консоль
+        if(!quiet)
+            printf("[Источник %3lld] Поступило: %" PRId64 ". (В буфере: %ld)\n", id, val, count);
 
-    // Освобождаем доступ
-    pthread_mutex_unlock(&m);
+        // Сигнал главному потоку, что появилась пара (или поступило последнее число).
+        // Лишние пробуждения при миллионах чисел стоили бы дороже самих сложений
+        if(count == 2 || active_src == 0)
+            pthread_cond_signal(&c);
+
+        // Освобождаем доступ
+        pthread_mutex_unlock(&m);
+    }
     return NULL;
 }
 
-// Поток-сумматор
+// Поток-сумматор из пула: берет задачи из очереди, пока не выставлен stop
 void* adder(void* arg) {
-    long packed = (long)arg;
-    // Распаковываем два числа из одного long (битовые операции)
-    int a = packed >> 16;
-    int b = packed & 0xFFFF;
-
-    unsigned int seed = time(NULL) ^ a;
-    sleep(3 + rand_r(&seed) % 4); // Задержка от 3 до 6 секунд
-    int sum = a + b;
+    long id = (long)arg; // Номер сумматора в пуле
+    unsigned int seed = time(NULL) ^ (id << 8);
 
-    // Блокируем доступ перед записью результата
     pthread_mutex_lock(&m);
+    while(1) {
+        // Ждем задачу
+        while(task_count == 0 && !stop)
+            pthread_cond_wait(&task_c, &m);
+        if(task_count == 0)
+            break;
 
-    buffer[count++] = sum; // Возвращаем сумму в общий буфер
-    active_add--; // Уменьшаем счетчик активных сумматоров
+        // Забираем задачу из очереди; если очередь была заполнена, главный поток мог ждать места
+        task_t task = tasks[task_head];
+        task_head = (task_head + 1) % task_cap;
+        if(task_count-- == task_cap)
+            pthread_cond_signal(&c);
 
-    printf("[Сумматор] %d + %d = %d. (В буфере: %d)\n", a, b, sum, count);
+        // Считаем без мьютекса, чтобы не мешать остальным потокам
+        pthread_mutex_unlock(&m);
+        delay(3 + rand_r(&seed) % 4); // Задержка от 3 до 6 секунд
+        int64_t sum;
+        int over = __builtin_add_overflow(task.a, task.b, &sum);
+        pthread_mutex_lock(&m);
+
+        if(over && !overflow)
+            printf("[Сумматор %ld] Переполнение: %" PRId64 " + %" PRId64 " не помещается в int64\n",
+                   id, task.a, task.b);
+        overflow |= over;
+
+        push_value(sum); // Возвращаем сумму в общий буфер (место освободила сама пара)
+        active_add--; // Уменьшаем счетчик активных сумматоров
 
-    // Сигнал главному потоку
-    pthread_cond_signal(&c);
+        if(!quiet)
+            printf("[Сумматор %ld] %" PRId64 " + %" PRId64 " = %" PRId64 ". (В буфере: %ld)\n",
+                   id, task.a, task.b, sum, count);
 
+        // Сигнал главному потоку: появилась пара или, возможно, вычисление закончено
+        if(count == 2 || active_add == 0)
+            pthread_cond_signal(&c);
+    }
     pthread_mutex_unlock(&m);
     return NULL;
 }
 
-int main() {
-    // Инициализация мьютекса и условной переменной
+int main(int argc, char *argv[]) {
+    // Размер пула сумматоров: по числу процессоров или из опции -t
+    long workers = sysconf(_SC_NPROCESSORS_ONLN);
+    int opt;
+    while((opt = getopt(argc, argv, "t:n:p:b:d:v:q")) != -1) {
+        switch(opt) {
+        case 't': workers = atol(optarg); break;
+        case 'n': sources = atoll(optarg); break;
+        case 'p': producers = atol(optarg); break;
+        case 'b': limit = atol(optarg); break;
+        case 'd': delay_pct = atoi(optarg); break;
+        case 'v': max_value = atoll(optarg); break;
+        case 'q': quiet = 1; break;
+        default:
+            fprintf(stderr, "Использование: %s [-t число_сумматоров] [-n число_источников] [-p потоков_источников]\n"
+                            "       [-b предел_буфера] [-d задержка_%%] [-v макс_число] [-q]\n", argv[0]);
+            return 1;
+        }
+    }
+    if(workers < 1)
+        workers = 1;
+    if(sources < 1)
+        sources = 1;
+    // По умолчанию поток на каждый источник, но не больше 100 потоков
+    if(producers < 1)
+        producers = sources < 100 ? sources : 100;
+    if(producers > sources)
+        producers = sources;
+    if(limit < 2)
+        limit = 2;
+    if(max_value < 1)
+        max_value = 1;
+    active_src = sources;
+
+    // Инициализация мьютекса и условных переменных
     pthread_mutex_init(&m, NULL);
     pthread_cond_init(&c, NULL);
+    pthread_cond_init(&task_c, NULL);
+    pthread_cond_init(&space_c, NULL);
+
+    // Очередь задач: по 64 задачи на сумматор. С короткой очередью главный поток и сумматоры
+    // будили бы друг друга на каждой паре, а так сумматор разбирает задачи пачкой
+    task_cap = 64 * workers;
+    tasks = malloc(task_cap * sizeof(task_t));
+
+    // Запускаем пул сумматоров один раз: дальше потоки не создаются
+    pthread_t *pool = malloc(workers * sizeof(pthread_t));
+    pthread_t *src = malloc(producers * sizeof(pthread_t));
+    if(!tasks || !pool || !src) {
+        perror("malloc");
+        return 1;
+    }
+    for(long i = 0; i < workers; i++)
+        pthread_create(&pool[i], NULL, adder, (void*)(i + 1));
+    printf("Источников: %lld, потоков-источников: %ld, сумматоров в пуле: %ld\n", sources, producers, workers);
 
-    pthread_t t;
-    // Запускаем 100 потоков-источников
-    // Передаем i как аргумент (ID источника)
-    for(long i = 1; i <= 100; i++)
-        pthread_create(&t, NULL, source, (void*)i);
+    // Запускаем потоки-источники
+    // Передаем номер первого источника потока
+    for(long i = 1; i <= producers; i++)
+        pthread_create(&src[i - 1], NULL, source, (void*)i);
 
     pthread_mutex_lock(&m);
 
     // Бесконечный цикл главного потока
     while(1) {
-        // Пока в буфере меньше 2 чисел, мы не можем запустить суммирование
-        while(count < 2) {
+        // Пока в буфере меньше 2 чисел или очередь задач заполнена, ставить задачу нельзя
+        while(count < 2 || task_count == task_cap) {
             // Проверка условия завершения программы
             if(active_src == 0 && active_add == 0 && count == 1) {
-                printf("ИТОГ: %d\n", buffer[0]);
+                if(overflow)
+                    printf("ИТОГ: переполнение, сумма не помещается в int64\n");
+                else
+                    printf("ИТОГ: %" PRId64 "\n", buffer[0]);
+                if(quiet && src_overflow)
+                    printf("Сумма поступивших чисел: переполнение, буфер: %ld чисел\n", capacity);
+                else if(quiet)
+                    printf("Сумма поступивших чисел: %" PRId64 ", буфер: %ld чисел\n", src_sum, capacity);
 
-                // Корректное завершение и выход из программы
+                // Останавливаем пул и ждем завершения всех потоков
+                stop = 1;
+                pthread_cond_broadcast(&task_c);
                 pthread_mutex_unlock(&m);
+                for(long i = 0; i < workers; i++)
+                    pthread_join(pool[i], NULL);
+                for(long i = 0; i < producers; i++)
+                    pthread_join(src[i], NULL);
+                free(pool);
+                free(src);
+                free(tasks);
+                free(buffer);
+
+                // Корректное завершение и выход из программы
                 pthread_mutex_destroy(&m);
                 pthread_cond_destroy(&c);
-                return 0;
+                pthread_cond_destroy(&task_c);
+                pthread_cond_destroy(&space_c);
+                return overflow;
             }
             // Ждем сигнала от потоков, если данных мало
             pthread_cond_wait(&c, &m);
         }
 
-        // Берем два последних числа из буфера
-        int a = buffer[--count];
-        int b = buffer[--count];
+        // Берем два последних числа из буфера и ставим задачу в очередь пула
+        task_t *task = &tasks[(task_head + task_count) % task_cap];
+        task->a = buffer[--count];
+        task->b = buffer[--count];
+        task_count++;
         active_add++; // Увеличиваем счетчик запущенных сумматоров
 
-        // Упаковываем два числа в одну переменную
-        long packed = (a << 16) | b;
-
-        // Разблокируем мьютекс, чтобы создать поток
-        pthread_mutex_unlock(&m);
-
-        // Запускаем поток-сумматор
-        pthread_create(&t, NULL, adder, (void*)packed);
-        pthread_detach(t);
-
-        // Блокируем мьютекс для следующей итерации
-        pthread_mutex_lock(&m);
+        // Будим один свободный сумматор. Источники будим, только когда буфер освободился
+        // наполовину: если будить их на каждой паре, потоки только и делают, что переключаются
+        pthread_cond_signal(&task_c);
+        if(src_waiting && count <= limit / 2) {
+            src_waiting = 0;
+            pthread_cond_broadcast(&space_c);
+        }
     }
 }
@@ -1,48 +1,262 @@
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <signal.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <fcntl.h>
 #include <time.h>
 
-#define SHM_NAME "/my-shm" // Имя объекта разделяемой памяти в системе POSIX
-
-// Структура разделяемой памяти
-typedef struct {
-    int value;      // Генерируемое число
-    int terminate;  // Флаг завершения
-} shm_data_t;
+#include "shm.h"
 
 volatile shm_data_t *data = NULL; // Указатель на область памяти
-int shm_fd;                       // Дескриптор разделяемой памяти
+int shm_fd = -1;                  // Дескриптор разделяемой памяти
+const char *huge_path = NULL;     // Файл в hugetlbfs вместо объекта POSIX (-H)
+
+// Удалить общий сегмент
+static void remove_segment(void) {
+    if (huge_path)
+        unlink(huge_path);
+    else
+        shm_unlink(SHM_NAME);
+}
 
 // Метод для выхода из программы с помощью Ctrl+C
 void cleanup_and_exit(int signo) {
+    (void)signo;
     if (data) {
         data->terminate = 1;    // Сигнал завершения
+        // Будим сервер, иначе он может уснуть навсегда
+        futex_bump(&data->data_seq);
+        futex_wake(&data->rec_seq);
+        futex_bump(&data->space_seq); // В режиме MPMC могут спать другие клиенты
     }
     if (shm_fd != -1) {
-        shm_unlink(SHM_NAME);   // Удаляем общий сегмент
+        remove_segment();       // Удаляем общий сегмент
     }
     exit(0);
 }
 
-int main() {
-    shm_fd = shm_open(SHM_NAME, O_CREAT | O_RDWR, 0666); // Открываем объект
+// Округление вверх до степени двойки, не больше MAX_CAPACITY (иначе сдвиг обнулит p)
+static uint32_t round_pow2(uint64_t n) {
+    uint32_t p = 1;
+    while (p < n && p < MAX_CAPACITY)
+        p <<= 1;
+    return p;
+}
+
+// Размер с необязательным суффиксом K, M или G
+static uint64_t parse_size(const char *str) {
+    char *end;
+    uint64_t n = strtoull(str, &end, 0);
+    switch (*end) {
+    case 'G': case 'g': n <<= 10; /* fallthrough */
+    case 'M': case 'm': n <<= 10; /* fallthrough */
+    case 'K': case 'k': n <<= 10;
+    }
+    return n;
+}
+
+// Режим MPMC: клиентов может быть несколько. Первый клиент создаёт сегмент (O_EXCL)
+// и размечает очередь, остальные подключаются к готовому сегменту.
+// Последний завершившийся клиент ставит terminate и удаляет сегмент.
+static int run_mpmc(uint32_t capacity, long delay_us, long long limit, int quiet) {
+    int creator = 1;
+    shm_fd = shm_open(SHM_NAME, O_CREAT | O_EXCL | O_RDWR, 0666);
+    if (shm_fd == -1 && errno == EEXIST) {
+        creator = 0;
+        shm_fd = shm_open(SHM_NAME, O_RDWR, 0666);
+    }
+    if (shm_fd == -1) {
+        perror("shm_open");
+        return 1;
+    }
+
+    size_t size = mpmc_size(capacity);
+    if (creator) {
+        if (ftruncate(shm_fd, size) == -1) {
+            perror("ftruncate");
+            shm_unlink(SHM_NAME);
+            return 1;
+        }
+    } else {
+        // Размер выбрал первый клиент - ждём его ftruncate
+        struct stat st;
+        do {
+            if (fstat(shm_fd, &st) == -1) {
+                perror("fstat");
+                return 1;
+            }
+        } while ((size_t)st.st_size < sizeof(shm_data_t) && usleep(10000) == 0);
+        size = st.st_size;
+    }
+
+    data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    if (data == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    if (creator) {
+        // Новый сегмент заполнен нулями, размечаем только очередь
+        data->capacity = capacity;
+        data->mask = capacity - 1;
+        data->mode = MODE_MPMC;
+        for (uint32_t i = 0; i < capacity; i++)
+            mpmc_cells(data)[i].turn = i;
+        __atomic_store_n(&data->ready, 1, __ATOMIC_RELEASE);
+    } else {
+        while (!__atomic_load_n(&data->ready, __ATOMIC_ACQUIRE))
+            usleep(10000);
+        if (data->mode != MODE_MPMC || data->terminate) {
+            fprintf(stderr, "Сегмент %s занят другим режимом или уже завершён\n", SHM_NAME);
+            return 1;
+        }
+    }
+    __atomic_add_fetch(&data->producers, 1, __ATOMIC_SEQ_CST);
+
+    signal(SIGINT, cleanup_and_exit); // Обработчик сигнала SIGINT
+
+    srand(time(NULL) ^ getpid()); // У каждого клиента свои числа
+    shm_msg_t msg = { 0, 0, 0, 0 };
+    msg.producer = __atomic_fetch_add(&data->producer_ids, 1, __ATOMIC_RELAXED);
+    uint64_t sum = 0;      // Ещё не добавленная в сегмент сумма
+    uint64_t unpublished = 0; // Сколько сообщений ещё не добавлено в счётчик сегмента
+    long long start = now_ns();
+
+    while (!data->terminate && (limit == 0 || (long long)msg.seq < limit)) {
+        msg.value = rand() % 1000;
+        msg.sent_ns = now_ns();
+        if (mpmc_push(data, &msg) < 0)
+            break;
+        sum += msg.value;
+        if (!quiet)
+            printf("Client %d generated: %d\n", msg.producer, msg.value);
+        msg.seq++;
+        // Счётчики в сегменте обновляются пачками: серверы видят ход передачи,
+        // а общая строка кэша не дёргается на каждое сообщение
+        if (++unpublished == COUNTER_BATCH || delay_us) {
+            __atomic_add_fetch(&data->enqueued, unpublished, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&data->enqueued_sum, sum, __ATOMIC_RELAXED);
+            unpublished = sum = 0;
+        }
+        if (delay_us)
+            usleep(delay_us);
+    }
+
+    __atomic_add_fetch(&data->enqueued, unpublished, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&data->enqueued_sum, sum, __ATOMIC_RELAXED);
+
+    double seconds = (now_ns() - start) / 1e9;
+    printf("Клиент %d отправил: %llu сообщений за %.3f с (%.0f сообщений/с)\n", msg.producer,
+           (unsigned long long)msg.seq, seconds, seconds > 0 ? msg.seq / seconds : 0);
+
+    // Последний клиент завершает серверы: они дочитают очередь и выйдут
+    if (__atomic_sub_fetch(&data->producers, 1, __ATOMIC_SEQ_CST) == 0) {
+        __atomic_store_n(&data->terminate, 1, __ATOMIC_RELEASE);
+        futex_bump(&data->data_seq);
+        shm_unlink(SHM_NAME);
+    }
+    close(shm_fd);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t capacity = DEFAULT_RING_SIZE; // Размер кольца (-n)
+    long delay_us = 1000000;               // Пауза между числами (-d), 0 - без пауз
+    long long limit = 0;                   // Сколько чисел сгенерировать (-c), 0 - до Ctrl+C
+    int quiet = 0;                         // Не печатать каждое число (-q)
+    int mode = MODE_RING;                  // Способ обмена (-m ring|seqlock|mpmc|broadcast)
+    int overwrite = 0;                     // Широковещательный режим: затирать, не ждать серверы (-o)
+    uint32_t bytes_capacity = DEFAULT_BYTES_SIZE; // Байтовый режим: размер области (-s)
+    uint64_t max_len = 1 << 20;            // Байтовый режим: наибольшая длина сообщения (-L)
+    int c;
+
+    while ((c = getopt(argc, argv, "n:d:c:m:os:L:H:q")) != -1) {
+        switch (c) {
+        case 'm':
+            if (strcmp(optarg, "ring") == 0)         mode = MODE_RING;
+            else if (strcmp(optarg, "seqlock") == 0) mode = MODE_SEQLOCK;
+            else if (strcmp(optarg, "mpmc") == 0)    mode = MODE_MPMC;
+            else if (strcmp(optarg, "broadcast") == 0) mode = MODE_BROADCAST;
+            else if (strcmp(optarg, "bytes") == 0)   mode = MODE_BYTES;
+            else {
+                fprintf(stderr, "Неизвестный режим: %s\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'n': {
+            uint64_t n = strtoull(optarg, NULL, 0);
+            if (n < 2 || n > MAX_CAPACITY) {
+                fprintf(stderr, "Размер кольца должен быть от 2 до %u\n", MAX_CAPACITY);
+                exit(1);
+            }
+            capacity = round_pow2(n);
+            break;
+        }
+        case 'd': delay_us = atol(optarg); break;
+        case 'c': limit = atoll(optarg); break;
+        case 'o': overwrite = 1; break;
+        case 's': {
+            uint64_t n = parse_size(optarg);
+            if (n < 1 || n > MAX_CAPACITY) {
+                fprintf(stderr, "Размер области должен быть от 1 байта до 2G\n");
+                exit(1);
+            }
+            bytes_capacity = round_pow2(n);
+            break;
+        }
+        case 'L':
+            max_len = parse_size(optarg);
+            if (max_len < 1) {
+                fprintf(stderr, "Длина сообщения должна быть не меньше 1 байта\n");
+                exit(1);
+            }
+            break;
+        case 'H': huge_path = optarg; break;
+        case 'q': quiet = 1; break;
+        default:
+            fprintf(stderr, "Использование: %s [-n размер_кольца] [-d пауза_мкс] [-c сколько]\n"
+                            "       [-m ring|seqlock|mpmc|broadcast|bytes] [-o] [-s размер_области]\n"
+                            "       [-L макс_длина] [-H файл_в_hugetlbfs] [-q]\n", argv[0]);
+            exit(1);
+        }
+    }
+
+    if (mode == MODE_MPMC)
+        return run_mpmc(capacity, delay_us, limit, quiet);
+
+    if (mode == MODE_BYTES && bytes_record_size(max_len) > bytes_capacity) {
+        fprintf(stderr, "Сообщение длины %llu не помещается в область %u байт\n",
+                (unsigned long long)max_len, bytes_capacity);
+        exit(1);
+    }
+
+    // Объект POSIX или файл в hugetlbfs, тогда сегмент лежит в huge pages
+    if (huge_path)
+        shm_fd = open(huge_path, O_CREAT | O_RDWR, 0666);
+    else
+        shm_fd = shm_open(SHM_NAME, O_CREAT | O_RDWR, 0666); // Открываем объект
     // Обработка ошибки
     if (shm_fd == -1) {
         printf("Opening error\n");
-        perror("shm_open");
+        perror(huge_path ? huge_path : "shm_open");
         exit(1);
     }
-    if (ftruncate(shm_fd, sizeof(shm_data_t)) == -1) {
+    size_t size = mode == MODE_BYTES ? bytes_size(bytes_capacity) : shm_size(capacity);
+    if (huge_path)
+        size = (size + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+    if (ftruncate(shm_fd, size) == -1) {
         perror("ftruncate");
         exit(1);
     }
 
-    // Получить доступ к памяти
-    data = mmap(NULL, sizeof(shm_data_t), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    // Получить доступ к памяти. В байтовом режиме страницы заводятся сразу (MAP_POPULATE),
+    // чтобы первые большие сообщения не платили за page fault.
+    data = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                MAP_SHARED | (mode == MODE_BYTES ? MAP_POPULATE : 0), shm_fd, 0);
     // Обработка ошибки
     if (data == MAP_FAILED) {
         perror("mmap");
@@ -50,17 +264,101 @@ int main() {
     }
 
     data->terminate = 0; // Инициализация флага завершения
+    data->capacity = mode == MODE_BYTES ? bytes_capacity : capacity;
+    data->mask = data->capacity - 1;
+    data->head = data->tail = 0;
+    data->producer_waiting = data->consumer_waiting = 0;
+    data->mode = mode;
+    data->rec_seq = 0;
+    data->record_waiting = 0;
+    data->overwrite = overwrite;
+    memset((void *)data->readers, 0, sizeof(data->readers)); // Серверы подключатся позже
+    __atomic_store_n(&data->ready, 1, __ATOMIC_RELEASE); // Сервер может подключаться
 
     signal(SIGINT, cleanup_and_exit); // Обработчик сигнала SIGINT
 
     srand(time(NULL)); // Инициализация генератора чисел
-    // Основной цикл генерирует рандомные числа до Ctrl+C
-    while (!data->terminate) {
-        data->value = rand() % 1000; // Как в семинаре, генерим числа до 999
-        printf("Client generated: %d\n", data->value);
-        sleep(1);
+    uint64_t cached_tail = 0, cached_min = 0;
+    long long start = now_ns();
+    shm_msg_t msg = { 0, 0, 0, 0 };
+    shm_record_t rec;
+    rec.producer_pid = getpid();
+
+    // В режиме seqlock клиент не ждёт сервер: каждая новая запись затирает предыдущую,
+    // сервер читает последнюю опубликованную запись целиком
+    while (mode == MODE_SEQLOCK && !data->terminate && (limit == 0 || (long long)msg.seq < limit)) {
+        rec.counter = msg.seq;
+        rec.value = rand() % 1000;
+        rec.timestamp_ns = now_ns();
+        for (int i = 0; i < PAYLOAD_SIZE; i++)
+            rec.payload[i] = (unsigned char)(rec.counter + i);
+        seqlock_publish(data, &rec);
+        if (!quiet)
+            printf("Client published: %d (запись %llu)\n", rec.value, (unsigned long long)rec.counter);
+        msg.seq++;
+        if (delay_us)
+            usleep(delay_us);
+    }
+
+    // Основной цикл генерирует рандомные числа до Ctrl+C (или до -c чисел).
+    // Каждое число кладётся в кольцо, поэтому сервер получит все числа по порядку.
+    while (mode == MODE_RING && !data->terminate && (limit == 0 || (long long)msg.seq < limit)) {
+        msg.value = rand() % 1000; // Как в семинаре, генерим числа до 999
+        msg.sent_ns = now_ns();
+        if (ring_push(data, &msg, &cached_tail) < 0)
+            break;
+        if (!quiet)
+            printf("Client generated: %d\n", msg.value);
+        msg.seq++;
+        if (delay_us)
+            usleep(delay_us);
+    }
+
+    // Широковещательный режим: каждое число получат все подключённые серверы.
+    // Клиент ждёт только самого медленного сервера (или затирает, если задан -o).
+    while (mode == MODE_BROADCAST && !data->terminate && (limit == 0 || (long long)msg.seq < limit)) {
+        msg.value = rand() % 1000;
+        msg.sent_ns = now_ns();
+        if (bcast_push(data, &msg, &cached_min) < 0)
+            break;
+        if (!quiet)
+            printf("Client generated: %d\n", msg.value);
+        msg.seq++;
+        if (delay_us)
+            usleep(delay_us);
     }
 
+    // Байтовый режим: сообщения случайной длины пишутся прямо в сегмент, без промежуточного буфера
+    uint64_t bytes_sent = 0;
+    while (mode == MODE_BYTES && !data->terminate && (limit == 0 || (long long)msg.seq < limit)) {
+        uint64_t len = 1 + (uint64_t)rand() % max_len;
+        unsigned char *p = bytes_reserve(data, len, &cached_tail);
+        if (!p)
+            break;
+        memset(p, (int)(msg.seq & 0xff), len); // Сервер проверит байты по номеру сообщения
+        bytes_commit(data, len, msg.seq);
+        bytes_sent += len;
+        if (!quiet)
+            printf("Client wrote: %llu байт (сообщение %llu)\n",
+                   (unsigned long long)len, (unsigned long long)msg.seq);
+        msg.seq++;
+        if (delay_us)
+            usleep(delay_us);
+    }
+
+    double seconds = (now_ns() - start) / 1e9;
+    printf("Отправлено: %llu сообщений за %.3f с (%.0f сообщений/с)\n",
+           (unsigned long long)msg.seq, seconds, seconds > 0 ? msg.seq / seconds : 0);
+    if (mode == MODE_BYTES)
+        printf("Отправлено байт: %llu (%.1f МБ/с)\n", (unsigned long long)bytes_sent,
+               seconds > 0 ? bytes_sent / 1048576.0 / seconds : 0);
+
+    // Сервер дочитает оставшиеся сообщения и завершится сам: terminate видно
+    // только после всех сообщений
+    __atomic_store_n(&data->terminate, 1, __ATOMIC_RELEASE);
+    futex_bump(&data->data_seq);
+    futex_wake(&data->rec_seq);
+    remove_segment();
     close(shm_fd); // Закрыть открытый объект
     return 0;
 }
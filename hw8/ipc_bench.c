@@ -0,0 +1,378 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <mqueue.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "shm.h"
+
+// Сравнение способов обмена между процессами: разделяемая память (кольцо из ДЗ8),
+// сигналы (как в ДЗ9, но RT-сигнал через sigqueue), pipe, сокет Unix, очередь POSIX и eventfd.
+// Направление 0 - от родителя к потомку, 1 - обратно.
+
+#define WARMUP 1000      // Столько обменов в начале не учитываем
+#define MQ_DEPTH 10      // Глубина очереди POSIX (ограничение по умолчанию в /proc/sys/fs/mqueue)
+
+static pid_t peer;                       // PID второго процесса (для сигналов)
+static volatile shm_data_t *rings[2];    // Кольца разделяемой памяти
+static uint64_t cached[2];               // Закэшированный чужой индекс кольца
+static uint64_t sent_seq;                // Номер следующего сообщения в кольцо
+static int fds[2][2];                    // pipe: [направление][0 - чтение, 1 - запись]
+static int sock[2];                      // socketpair: sock[0] у родителя, sock[1] у потомка
+static mqd_t mq[2];
+static int efd[2];
+
+static void die(const char *what) {
+    perror(what);
+    exit(1);
+}
+
+// Разделяемая память: по кольцу SPSC на направление, анонимное отображение переживает fork
+static void shm_setup(void) {
+    for (int d = 0; d < 2; d++) {
+        rings[d] = mmap(NULL, shm_size(DEFAULT_RING_SIZE), PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (rings[d] == MAP_FAILED)
+            die("mmap");
+        rings[d]->capacity = DEFAULT_RING_SIZE;
+        rings[d]->mask = DEFAULT_RING_SIZE - 1;
+    }
+}
+
+static void shm_send(int d) {
+    shm_msg_t msg = { sent_seq++, 0, 0, 0 };
+    ring_push(rings[d], &msg, &cached[d]);
+}
+
+static int shm_recv(int d) {
+    shm_msg_t msg;
+    ring_pop(rings[d], &msg, &cached[d]);
+    return 1;
+}
+
+static void shm_cleanup(void) {
+    for (int d = 0; d < 2; d++)
+        munmap((void *)rings[d], shm_size(DEFAULT_RING_SIZE));
+}
+
+// Сигналы: RT-сигналы не склеиваются и несут значение; ждём их через sigwaitinfo
+static void sig_setup(void) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGRTMIN);
+    sigprocmask(SIG_BLOCK, &set, NULL); // Блокируем до fork - потомок унаследует маску
+}
+
+static void sig_send(int d) {
+    (void)d;
+    union sigval v = { .sival_int = (int)sent_seq++ };
+    // Очередь сигналов получателя ограничена (RLIMIT_SIGPENDING) - ждём, пока он разберёт
+    while (sigqueue(peer, SIGRTMIN, v) == -1) {
+        if (errno != EAGAIN)
+            die("sigqueue");
+        sched_yield();
+    }
+}
+
+static int sig_recv(int d) {
+    (void)d;
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGRTMIN);
+    while (sigwaitinfo(&set, NULL) == -1)
+        if (errno != EINTR)
+            die("sigwaitinfo");
+    return 1;
+}
+
+static void sig_cleanup(void) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGRTMIN);
+    sigprocmask(SIG_UNBLOCK, &set, NULL);
+}
+
+// Общие чтение и запись 8 байт для pipe и сокета
+static void write_msg(int fd) {
+    uint64_t v = sent_seq++;
+    if (write(fd, &v, sizeof(v)) != sizeof(v))
+        die("write");
+}
+
+static void read_msg(int fd) {
+    uint64_t v;
+    if (read(fd, &v, sizeof(v)) != sizeof(v))
+        die("read");
+}
+
+static void pipe_setup(void) {
+    if (pipe(fds[0]) == -1 || pipe(fds[1]) == -1)
+        die("pipe");
+}
+
+static void pipe_send(int d) { write_msg(fds[d][1]); }
+static int pipe_recv(int d) { read_msg(fds[d][0]); return 1; }
+
+static void pipe_cleanup(void) {
+    for (int d = 0; d < 2; d++) {
+        close(fds[d][0]);
+        close(fds[d][1]);
+    }
+}
+
+// Сокет Unix: SOCK_SEQPACKET сохраняет границы сообщений
+static void sock_setup(void) {
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sock) == -1)
+        die("socketpair");
+}
+
+// Направление 0 пишет родитель в sock[0], потомок читает из sock[1]
+static void sock_send(int d) { write_msg(sock[d]); }
+static int sock_recv(int d) { read_msg(sock[1 - d]); return 1; }
+
+static void sock_cleanup(void) {
+    close(sock[0]);
+    close(sock[1]);
+}
+
+// Очереди сообщений POSIX: имена удаляются сразу, дескрипторы наследуются через fork
+static void mq_setup(void) {
+    struct mq_attr attr = { .mq_maxmsg = MQ_DEPTH, .mq_msgsize = sizeof(uint64_t) };
+    for (int d = 0; d < 2; d++) {
+        char name[64];
+        snprintf(name, sizeof(name), "/ipc-bench-%d-%d", getpid(), d);
+        mq[d] = mq_open(name, O_CREAT | O_EXCL | O_RDWR, 0600, &attr);
+        if (mq[d] == (mqd_t)-1)
+            die("mq_open");
+        mq_unlink(name);
+    }
+}
+
+static void mq_send_msg(int d) {
+    uint64_t v = sent_seq++;
+    if (mq_send(mq[d], (const char *)&v, sizeof(v), 0) == -1)
+        die("mq_send");
+}
+
+static int mq_recv_msg(int d) {
+    uint64_t v;
+    if (mq_receive(mq[d], (char *)&v, sizeof(v), NULL) == -1)
+        die("mq_receive");
+    return 1;
+}
+
+static void mq_cleanup(void) {
+    mq_close(mq[0]);
+    mq_close(mq[1]);
+}
+
+// eventfd: каждая запись прибавляет 1 к счётчику, чтение забирает все накопленные
+// сообщения сразу - поэтому recv возвращает их число
+static void efd_setup(void) {
+    for (int d = 0; d < 2; d++)
+        if ((efd[d] = eventfd(0, 0)) == -1)
+            die("eventfd");
+}
+
+static void efd_send(int d) {
+    uint64_t one = 1;
+    if (write(efd[d], &one, sizeof(one)) != sizeof(one))
+        die("write");
+}
+
+static int efd_recv(int d) {
+    uint64_t n;
+    if (read(efd[d], &n, sizeof(n)) != sizeof(n))
+        die("read");
+    return (int)n;
+}
+
+static void efd_cleanup(void) {
+    close(efd[0]);
+    close(efd[1]);
+}
+
+// Способ обмена
+typedef struct {
+    const char *name;
+    void (*setup)(void);      // До fork: создать оба направления
+    void (*send)(int d);      // Отправить одно сообщение в направлении d
+    int (*recv)(int d);       // Дождаться сообщений из направления d, вернуть их число
+    void (*cleanup)(void);
+} transport_t;
+
+static const transport_t transports[] = {
+    { "shm",     shm_setup,  shm_send,    shm_recv,    shm_cleanup },
+    { "signal",  sig_setup,  sig_send,    sig_recv,    sig_cleanup },
+    { "pipe",    pipe_setup, pipe_send,   pipe_recv,   pipe_cleanup },
+    { "unix",    sock_setup, sock_send,   sock_recv,   sock_cleanup },
+    { "mqueue",  mq_setup,   mq_send_msg, mq_recv_msg, mq_cleanup },
+    { "eventfd", efd_setup,  efd_send,    efd_recv,    efd_cleanup },
+};
+
+#define NTRANSPORTS (int)(sizeof(transports) / sizeof(transports[0]))
+
+static void pin(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) == -1)
+        die("sched_setaffinity");
+}
+
+static int cmp_ll(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+// Запустить потомка на cpu: в режиме ping-pong он отвечает на каждое сообщение,
+// в потоковом - просто принимает n сообщений
+static pid_t start_child(const transport_t *t, int cpu, long n, int pingpong) {
+    pid_t parent = getpid();
+    pid_t pid = fork();
+    if (pid == -1)
+        die("fork");
+    if (pid == 0) {
+        peer = parent;
+        pin(cpu);
+        if (pingpong) {
+            for (long i = 0; i < n + WARMUP; i++) {
+                t->recv(0);
+                t->send(1);
+            }
+        } else {
+            for (long got = 0; got < n; )
+                got += t->recv(0);
+        }
+        _exit(0);
+    }
+    peer = pid;
+    return pid;
+}
+
+// Ping-pong: время от отправки сообщения до получения ответа, по каждому обмену
+static void run_pingpong(const transport_t *t, int cpu0, int cpu1, long n, long long *lat) {
+    sent_seq = 0;
+    memset(cached, 0, sizeof(cached));
+    t->setup();
+    pid_t pid = start_child(t, cpu1, n, 1);
+    pin(cpu0);
+
+    long long start = 0;
+    for (long i = 0; i < n + WARMUP; i++) {
+        if (i == WARMUP)
+            start = now_ns();
+        long long t0 = now_ns();
+        t->send(0);
+        t->recv(1);
+        if (i >= WARMUP)
+            lat[i - WARMUP] = now_ns() - t0;
+    }
+    double seconds = (now_ns() - start) / 1e9;
+    waitpid(pid, NULL, 0);
+    t->cleanup();
+
+    qsort(lat, n, sizeof(lat[0]), cmp_ll);
+    printf("%s,pingpong,%ld,%.6f,%.0f,%lld,%lld,%lld\n", t->name, n, seconds, n / seconds,
+           lat[n / 2], lat[(long)(n * 0.99)], lat[(long)(n * 0.999)]);
+    fflush(stdout);
+}
+
+// Поток: родитель отправляет n сообщений, время - до момента, когда потомок принял все
+static void run_stream(const transport_t *t, int cpu0, int cpu1, long n) {
+    sent_seq = 0;
+    memset(cached, 0, sizeof(cached));
+    t->setup();
+    pid_t pid = start_child(t, cpu1, n, 0);
+    pin(cpu0);
+
+    long long start = now_ns();
+    for (long i = 0; i < n; i++)
+        t->send(0);
+    int status;
+    waitpid(pid, &status, 0);
+    double seconds = (now_ns() - start) / 1e9;
+    t->cleanup();
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        fprintf(stderr, "%s: потомок завершился с ошибкой\n", t->name);
+    printf("%s,stream,%ld,%.6f,%.0f,,,\n", t->name, n, seconds, n / seconds);
+    fflush(stdout);
+}
+
+// Есть ли name в списке через запятую
+static int in_list(const char *list, const char *name) {
+    size_t len = strlen(name);
+    for (const char *p = list; *p; p++) {
+        if ((p == list || p[-1] == ',') && strncmp(p, name, len) == 0 && (p[len] == ',' || p[len] == 0))
+            return 1;
+    }
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Использование: %s [-n сообщений] [-c cpu_родителя,cpu_потомка]\n"
+            "          [-t shm,signal,pipe,unix,mqueue,eventfd] [-m pingpong|stream|both]\n",
+            prog);
+}
+
+int main(int argc, char *argv[]) {
+    long n = 100000;                 // Сообщений в каждом тесте
+    int cpu0 = 0, cpu1 = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? 1 : 0; // Разные ядра, если есть
+    const char *only = NULL;         // Список способов через запятую
+    int pingpong = 1, stream = 1;
+    int c;
+
+    while ((c = getopt(argc, argv, "n:c:t:m:")) != -1) {
+        switch (c) {
+        case 'n': n = atol(optarg); break;
+        case 'c':
+            if (sscanf(optarg, "%d,%d", &cpu0, &cpu1) != 2) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 't': only = optarg; break;
+        case 'm':
+            pingpong = strcmp(optarg, "stream") != 0;
+            stream = strcmp(optarg, "pingpong") != 0;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (n <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    long long *lat = malloc(n * sizeof(lat[0]));
+    if (!lat)
+        die("malloc");
+
+    // Таблица для машинной обработки - CSV в stdout, задержки в наносекундах
+    printf("transport,test,messages,seconds,msgs_s,p50_ns,p99_ns,p999_ns\n");
+    for (int i = 0; i < NTRANSPORTS; i++) {
+        const transport_t *t = &transports[i];
+        if (only && !in_list(only, t->name))
+            continue;
+        fprintf(stderr, "%s (cpu %d и %d)\n", t->name, cpu0, cpu1);
+        if (pingpong)
+            run_pingpong(t, cpu0, cpu1, n, lat);
+        if (stream)
+            run_stream(t, cpu0, cpu1, n);
+    }
+    free(lat);
+    return 0;
+}
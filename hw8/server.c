@@ -3,51 +3,330 @@
 #include <unistd.h>
 #include <signal.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <fcntl.h>
 
-#define SHM_NAME "/my-shm" // Имя объекта разделяемой памяти в системе POSIX
-
-// Структура разделяемой памяти
-typedef struct {
-    int value;      // Генерируемое число
-    int terminate;  // Флаг завершения
-} shm_data_t;
+#include "shm.h"
 
 volatile shm_data_t *data = NULL; // Указатель на область памяти
 int shm_fd;                       // Дескриптор разделяемой памяти
+int reader_id = -1;               // Строка в таблице читателей (широковещательный режим)
 
 // Метод для выхода из программы с помощью Ctrl+C
 void cleanup_and_exit(int signo) {
+    (void)signo;
+    if (data && reader_id >= 0) {
+        // Широковещательный режим: уходит только этот сервер, остальные продолжают
+        bcast_detach(data, reader_id);
+        exit(0);
+    }
     if (data) {
         data->terminate = 1; // Сигнал завершения
+        // Клиент может спать, ожидая места в кольце
+        futex_bump(&data->space_seq);
     }
     exit(0); // Завершение процесса
 }
 
-int main() {
-    shm_fd = shm_open(SHM_NAME, O_RDWR, 0666); // Открываем объект
+// Режим seqlock: сервер читает последнюю опубликованную запись. Запись может
+// смениться прямо во время чтения - тогда seqlock_read повторяет чтение.
+static void serve_seqlock(int quiet) {
+    shm_record_t rec;
+    long long snapshots = 0, retries = 0, torn = 0, skipped = 0; // Статистика
+    long long start = now_ns(), report = start, report_snapshots = 0;
+    uint32_t version = 0;
+    uint64_t last_counter = 0;
+
+    // Ждём новую версию записи, читаем её снимок. Писатель может успеть опубликовать
+    // несколько записей между снимками - такие записи считаем пропущенными.
+    while (1) {
+        seqlock_wait(data, version);
+        if (data->terminate)
+            break;
+        version = seqlock_read(data, &rec, &retries);
+        if (version == 0)
+            continue; // клиент ещё ничего не опубликовал
+
+        // Согласованный снимок: все байты нагрузки соответствуют номеру записи
+        for (int i = 0; i < PAYLOAD_SIZE; i++) {
+            if (rec.payload[i] != (unsigned char)(rec.counter + i)) {
+                torn++;
+                break;
+            }
+        }
+        if (snapshots && rec.counter > last_counter + 1)
+            skipped += rec.counter - last_counter - 1;
+        last_counter = rec.counter;
+        snapshots++;
+
+        long long now = now_ns();
+        if (!quiet) {
+            printf("Server read: %d (запись %llu от %d, задержка %.1f мкс)\n", rec.value,
+                   (unsigned long long)rec.counter, rec.producer_pid, (now - rec.timestamp_ns) / 1000.0);
+        } else if (now - report >= 1000000000LL) {
+            printf("Снимков/с: %.0f, повторов чтения: %lld\n",
+                   (snapshots - report_snapshots) * 1e9 / (now - report), retries);
+            report = now;
+            report_snapshots = snapshots;
+        }
+    }
+
+    double seconds = (now_ns() - start) / 1e9;
+    printf("Прочитано: %lld снимков (%.0f/с), повторов чтения: %lld, пропущено записей: %lld, "
+           "разорванных снимков: %lld\n",
+           snapshots, seconds > 0 ? snapshots / seconds : 0, retries, skipped, torn);
+}
+
+// Режим MPMC: серверов может быть несколько, каждое сообщение получает ровно один из них
+static void serve_mpmc(int quiet) {
+    static uint64_t expected[MAX_PRODUCERS]; // Следующий номер от каждого клиента
+    shm_msg_t msg;
+    long long count = 0, errors = 0; // Статистика
+    long long start = now_ns(), report = start, report_count = 0;
+    uint64_t sum = 0, unpublished = 0; // Ещё не добавленные в сегмент сумма и число сообщений
+    int id = __atomic_fetch_add(&data->consumers, 1, __ATOMIC_SEQ_CST);
+
+    while (mpmc_pop(data, &msg) == 0) {
+        count++;
+        sum += msg.value;
+        // Счётчики сегмента обновляются пачками, как у клиентов
+        if (++unpublished == COUNTER_BATCH || !quiet) {
+            __atomic_add_fetch(&data->dequeued, unpublished, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&data->dequeued_sum, sum, __ATOMIC_RELAXED);
+            unpublished = sum = 0;
+        }
+        // Часть сообщений клиента забирают другие серверы, но номера от одного клиента
+        // должны идти по возрастанию
+        if (msg.producer >= 0 && msg.producer < MAX_PRODUCERS) {
+            if (msg.seq < expected[msg.producer])
+                errors++;
+            expected[msg.producer] = msg.seq + 1;
+        }
+
+        long long now = now_ns();
+        if (!quiet) {
+            printf("Server %d read: %d (от клиента %d)\n", id, msg.value, msg.producer);
+        } else if (now - report >= 1000000000LL) {
+            // Общий ход передачи виден по счётчикам сегмента, пока клиенты ещё работают
+            printf("Сервер %d, сообщений/с: %.0f, всего отправлено: %llu, получено: %llu\n", id,
+                   (count - report_count) * 1e9 / (now - report),
+                   (unsigned long long)__atomic_load_n(&data->enqueued, __ATOMIC_RELAXED),
+                   (unsigned long long)__atomic_load_n(&data->dequeued, __ATOMIC_RELAXED));
+            report = now;
+            report_count = count;
+        }
+    }
+
+    __atomic_add_fetch(&data->dequeued, unpublished, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&data->dequeued_sum, sum, __ATOMIC_RELAXED);
+    double seconds = (now_ns() - start) / 1e9;
+    printf("Сервер %d получил: %lld сообщений (%.0f/с), нарушений порядка: %lld\n",
+           id, count, seconds > 0 ? count / seconds : 0, errors);
+
+    // Последний сервер сверяет счётчики обеих сторон
+    if (__atomic_sub_fetch(&data->consumers, 1, __ATOMIC_SEQ_CST) == 0) {
+        uint64_t enq = __atomic_load_n(&data->enqueued, __ATOMIC_ACQUIRE);
+        uint64_t deq = __atomic_load_n(&data->dequeued, __ATOMIC_ACQUIRE);
+        printf("Всего отправлено: %llu, получено: %llu, суммы чисел %s\n",
+               (unsigned long long)enq, (unsigned long long)deq,
+               data->enqueued_sum == data->dequeued_sum ? "совпадают" : "НЕ совпадают");
+    }
+}
+
+// Широковещательный режим: сервер получает весь поток клиента, пока подключён
+static void serve_broadcast(int quiet) {
+    shm_msg_t msg;
+    long long count = 0, errors = 0, total_ns = 0; // Статистика
+    long long start = now_ns(), report = start, report_count = 0;
+    uint64_t lost = 0, expected = 0;
+
+    reader_id = bcast_attach(data);
+    if (reader_id < 0) {
+        fprintf(stderr, "Уже подключено %d серверов\n", MAX_READERS);
+        return;
+    }
+    expected = data->readers[reader_id].cursor;
+    printf("Сервер подключён как читатель %d, начиная с сообщения %llu\n",
+           reader_id, (unsigned long long)expected);
+
+    while (bcast_pop(data, reader_id, &msg, &lost) == 0) {
+        long long now = now_ns();
+        count++;
+        total_ns += now - msg.sent_ns;
+        // Пропуски из-за затирания учтены в lost, остальное - ошибка порядка
+        if (msg.seq < expected)
+            errors++;
+        expected = msg.seq + 1;
+
+        if (!quiet) {
+            printf("Server read: %d (задержка %.1f мкс)\n", msg.value, (now - msg.sent_ns) / 1000.0);
+        } else if (now - report >= 1000000000LL) {
+            printf("Сообщений/с: %.0f, пропущено: %llu\n",
+                   (count - report_count) * 1e9 / (now - report), (unsigned long long)lost);
+            report = now;
+            report_count = count;
+        }
+    }
+    bcast_detach(data, reader_id);
+
+    double seconds = (now_ns() - start) / 1e9;
+    printf("Получено: %lld сообщений (%.0f/с), пропущено из-за затирания: %llu, нарушений порядка: %lld, "
+           "средняя задержка %.1f мкс\n",
+           count, seconds > 0 ? count / seconds : 0, (unsigned long long)lost, errors,
+           count ? total_ns / 1000.0 / count : 0);
+}
+
+// Байтовый режим: сообщения читаются прямо из сегмента, без копирования
+static void serve_bytes(int quiet) {
+    bytes_hdr_t info;
+    const unsigned char *p;
+    uint64_t cached_head = 0, expected = 0, total = 0;
+    long long count = 0, errors = 0, corrupted = 0, total_ns = 0; // Статистика
+    long long start = now_ns(), report = start;
+    uint64_t report_total = 0;
+
+    while ((p = bytes_peek(data, &info, &cached_head)) != NULL) {
+        long long now = now_ns();
+        count++;
+        total += info.len;
+        total_ns += now - info.sent_ns;
+        if (info.seq != expected)
+            errors++;
+        expected = info.seq + 1;
+
+        // Все байты сообщения равны номеру сообщения: проверяем по байту на страницу и последний
+        unsigned char v = (unsigned char)info.seq;
+        for (uint64_t i = 0; i < info.len; i += 4096) {
+            if (p[i] != v) {
+                corrupted++;
+                break;
+            }
+        }
+        if (p[info.len - 1] != v)
+            corrupted++;
+
+        if (!quiet) {
+            printf("Server read: %u байт (сообщение %llu, задержка %.1f мкс)\n", info.len,
+                   (unsigned long long)info.seq, (now - info.sent_ns) / 1000.0);
+        } else if (now - report >= 1000000000LL) {
+            printf("МБ/с: %.1f\n", (total - report_total) / 1048576.0 * 1e9 / (now - report));
+            report = now;
+            report_total = total;
+        }
+        bytes_release(data);
+    }
+
+    double seconds = (now_ns() - start) / 1e9;
+    if (count)
+        printf("Получено: %lld сообщений, %llu байт (%.1f МБ/с), нарушений порядка: %lld, "
+               "испорченных: %lld, средняя задержка %.1f мкс\n",
+               count, (unsigned long long)total, total / 1048576.0 / seconds, errors, corrupted,
+               total_ns / 1000.0 / count);
+}
+
+int main(int argc, char *argv[]) {
+    int quiet = 0;                // -q: не печатать каждое число, только сообщений/с
+    const char *huge_path = NULL; // -H: сегмент - файл в hugetlbfs, как у клиента
+    int c;
+
+    while ((c = getopt(argc, argv, "qH:")) != -1) {
+        switch (c) {
+        case 'q': quiet = 1; break;
+        case 'H': huge_path = optarg; break;
+        default:
+            fprintf(stderr, "Использование: %s [-q] [-H файл_в_hugetlbfs]\n", argv[0]);
+            exit(1);
+        }
+    }
+
+    if (huge_path)
+        shm_fd = open(huge_path, O_RDWR);
+    else
+        shm_fd = shm_open(SHM_NAME, O_RDWR, 0666); // Открываем объект
     // Обработка ошибки
     if (shm_fd == -1) {
-        perror("shm_open");
+        perror(huge_path ? huge_path : "shm_open");
         exit(1);
     }
 
+    // Размер кольца задаёт клиент - узнаём размер сегмента, дождавшись ftruncate
+    struct stat st;
+    do {
+        if (fstat(shm_fd, &st) == -1) {
+            perror("fstat");
+            exit(1);
+        }
+    } while ((size_t)st.st_size < sizeof(shm_data_t) && usleep(10000) == 0);
+
     // Получить доступ к памяти
-    data = mmap(NULL, sizeof(shm_data_t), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
     // Обработка ошибки
     if (data == MAP_FAILED) {
         perror("mmap");
         exit(1);
     }
+    while (!__atomic_load_n(&data->ready, __ATOMIC_ACQUIRE))
+        usleep(10000);
 
     signal(SIGINT, cleanup_and_exit); // Обработчик сигнала SIGINT
 
-    // Цикл, выводящий текущее значение value из client, пока terminate = 0
-    while (!data->terminate) {
-        printf("Server read: %d\n", data->value);
-        sleep(1);
+    if (data->mode == MODE_SEQLOCK) {
+        serve_seqlock(quiet);
+        close(shm_fd);
+        return 0;
+    }
+    if (data->mode == MODE_BROADCAST) {
+        serve_broadcast(quiet);
+        close(shm_fd);
+        return 0;
+    }
+    if (data->mode == MODE_BYTES) {
+        // Заранее заводим страницы области, как клиент через MAP_POPULATE
+        madvise((void *)data, st.st_size, MADV_POPULATE_WRITE);
+        serve_bytes(quiet);
+        close(shm_fd);
+        return 0;
+    }
+    if (data->mode == MODE_MPMC) {
+        serve_mpmc(quiet);
+        close(shm_fd);
+        return 0;
     }
 
+    uint64_t cached_head = 0, expected = 0;
+    long long count = 0, errors = 0, total_ns = 0, max_ns = 0; // Статистика
+    long long start = now_ns(), report = start, report_count = 0;
+    shm_msg_t msg;
+
+    // Цикл, выводящий каждое число из кольца. Пока кольцо пустое, сервер спит в futex.
+    // После terminate сервер дочитывает то, что осталось в кольце.
+    while (ring_pop(data, &msg, &cached_head) == 0) {
+        long long now = now_ns();
+        long long latency = now - msg.sent_ns; // От записи клиентом до чтения сервером
+        count++;
+        total_ns += latency;
+        if (latency > max_ns)
+            max_ns = latency;
+        // Номера должны идти подряд: иначе сообщение потеряно или пришло не по порядку
+        if (msg.seq != expected)
+            errors++;
+        expected = msg.seq + 1;
+
+        if (!quiet) {
+            printf("Server read: %d (задержка %.1f мкс)\n", msg.value, latency / 1000.0);
+        } else if (now - report >= 1000000000LL) {
+            printf("Сообщений/с: %.0f\n", (count - report_count) * 1e9 / (now - report));
+            report = now;
+            report_count = count;
+        }
+    }
+
+    double seconds = (now_ns() - start) / 1e9;
+    if (count)
+        printf("Получено: %lld сообщений (%.0f/с), нарушений порядка: %lld, "
+               "средняя задержка %.1f мкс, максимальная %.1f мкс\n",
+               count, count / seconds, errors, total_ns / 1000.0 / count, max_ns / 1000.0);
+
     close(shm_fd); // Закрываем открытый объект
     return 0;
 }
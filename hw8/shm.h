@@ -0,0 +1,629 @@
+#ifndef SHM_H
+#define SHM_H
+
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include <signal.h>
+#include <linux/futex.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SHM_NAME "/my-shm"      // Имя объекта разделяемой памяти в системе POSIX
+#define CACHE_LINE 64           // Размер строки кэша: поля разных процессов не должны делить строку
+#define DEFAULT_RING_SIZE 1024  // Число ячеек кольца по умолчанию
+#define PAYLOAD_SIZE 232        // Полезная нагрузка записи, чтобы запись занимала 4 строки кэша
+#define MAX_PRODUCERS 64        // Сколько клиентов сервер различает при проверке порядка в MPMC
+#define MAX_READERS 32          // Сколько серверов может одновременно читать широковещательное кольцо
+#define SLOT_BUSY UINT64_MAX    // Метка ячейки, которую клиент сейчас перезаписывает
+#define DEFAULT_BYTES_SIZE (64 << 20) // Размер области байтового кольца по умолчанию
+#define HUGE_PAGE (2 << 20)     // Размер файла в hugetlbfs должен быть кратен huge page
+#define COUNTER_BATCH 256       // Через сколько сообщений MPMC-счётчики добавляются в сегмент
+#define MAX_CAPACITY (1u << 31) // Наибольший размер кольца: capacity в сегменте 32-битная
+
+// Режимы обмена, клиент записывает выбранный режим в заголовок сегмента
+enum {
+    MODE_RING,      // Каждое число доставляется через кольцо
+    MODE_SEQLOCK,   // Клиент публикует последнюю запись под seqlock, сервер читает снимки
+    MODE_MPMC,      // Очередь для нескольких клиентов и нескольких серверов
+    MODE_BROADCAST, // Один клиент, каждый сервер читает весь поток со своим курсором
+    MODE_BYTES      // Сообщения переменной длины, которые пишутся и читаются прямо в сегменте
+};
+
+// Типы записей байтового кольца
+enum {
+    REC_DATA,       // Сообщение
+    REC_PAD         // Заполнитель до конца области: следующая запись начинается с нуля
+};
+
+// Одно сообщение в кольце
+typedef struct {
+    uint64_t seq;       // Порядковый номер сообщения, по нему сервер проверяет порядок и пропуски
+    int value;          // Генерируемое число
+    int producer;       // Номер клиента (в режиме MPMC)
+    long long sent_ns;  // Когда клиент записал сообщение (CLOCK_MONOTONIC), для замера задержки
+} shm_msg_t;
+
+// Запись из нескольких полей, публикуемая под seqlock
+typedef struct {
+    uint64_t counter;       // Номер записи у клиента
+    long long timestamp_ns; // Когда клиент начал запись
+    int value;              // Генерируемое число
+    int producer_pid;       // PID клиента
+    unsigned char payload[PAYLOAD_SIZE]; // Байты (counter + i) & 0xff - по ним видно разорванное чтение
+} shm_record_t;
+
+// Ячейка очереди MPMC: turn говорит, чья очередь работать с ячейкой.
+// turn == pos - ячейка свободна для записи с позиции pos,
+// turn == pos + 1 - в ячейке сообщение для чтения с позиции pos.
+typedef struct {
+    uint64_t turn;
+    shm_msg_t msg;
+} mpmc_cell_t;
+
+// Заголовок записи байтового кольца, сразу за ним лежат len байт сообщения.
+// Записи выровнены по строке кэша, поэтому заголовок никогда не разрезается концом области.
+typedef struct {
+    uint32_t len;       // Длина сообщения (для REC_PAD - размер заполнителя вместе с заголовком)
+    uint32_t type;      // REC_DATA или REC_PAD
+    uint64_t seq;       // Номер сообщения
+    long long sent_ns;  // Когда клиент закончил запись сообщения
+} bytes_hdr_t;
+
+// Читатель широковещательного кольца: у каждого своя строка кэша, курсор двигает только он сам
+typedef struct {
+    _Alignas(CACHE_LINE) uint64_t cursor; // Номер следующего сообщения для чтения
+    uint32_t active;                      // 1 - читатель подключён и клиент его учитывает
+    int pid;                              // PID сервера, чтобы клиент мог убрать умерший сервер
+} reader_t;
+
+// Структура разделяемой памяти: заголовок и кольцо single-producer/single-consumer.
+// head двигает только клиент, tail - только сервер, поэтому блокировки не нужны:
+// достаточно публиковать индексы с порядком release и читать с acquire.
+// В режиме MPMC head и tail двигают все клиенты и все серверы через CAS,
+// а *_waiting становятся счётчиками спящих процессов.
+typedef struct {
+    int terminate;          // Флаг завершения
+    uint32_t capacity;      // Число ячеек (степень двойки)
+    uint32_t mask;          // capacity - 1
+    uint32_t ready;         // Клиент закончил инициализацию
+    int mode;               // MODE_RING, MODE_SEQLOCK, MODE_MPMC или MODE_BROADCAST
+    int overwrite;          // Широковещательный режим: не ждать медленных читателей, а затирать
+
+    // Строка клиента
+    _Alignas(CACHE_LINE) uint64_t head;  // Сколько сообщений записано
+    uint32_t data_seq;                   // futex-слово: меняется, когда появились данные
+    uint32_t producer_waiting;           // Клиент спит, ожидая свободного места
+
+    // Строка сервера
+    _Alignas(CACHE_LINE) uint64_t tail;  // Сколько сообщений прочитано
+    uint32_t space_seq;                  // futex-слово: меняется, когда освободилось место
+    uint32_t consumer_waiting;           // Сервер спит, ожидая данных
+
+    // Запись под seqlock: rec_seq нечётный, пока клиент пишет запись
+    _Alignas(CACHE_LINE) uint32_t rec_seq; // Заодно futex-слово для ожидания новой записи
+    uint32_t record_waiting;               // Сервер спит, ожидая новую запись
+    shm_record_t record;
+
+    // Счётчики режима MPMC: каждый процесс добавляет свои итоги при выходе
+    _Alignas(CACHE_LINE) uint32_t producers; // Сколько клиентов сейчас работает
+    uint32_t consumers;                      // Сколько серверов сейчас работает
+    uint32_t producer_ids;                   // Выдача номеров клиентам
+    uint64_t enqueued, dequeued;             // Сколько сообщений отправлено и получено (по ходу, пачками)
+    uint64_t enqueued_sum, dequeued_sum;     // Суммы чисел: должны совпасть, если ничего не потеряно
+
+    // Таблица читателей широковещательного режима
+    reader_t readers[MAX_READERS];
+
+    _Alignas(CACHE_LINE) shm_msg_t slots[]; // Ячейки кольца
+} shm_data_t;
+
+// Размер сегмента для кольца из capacity ячеек
+static inline size_t shm_size(uint32_t capacity) {
+    return sizeof(shm_data_t) + (size_t)capacity * sizeof(shm_msg_t);
+}
+
+// Ячейки очереди MPMC лежат на месте slots
+static inline volatile mpmc_cell_t *mpmc_cells(volatile shm_data_t *shm) {
+    return (volatile mpmc_cell_t *)shm->slots;
+}
+
+// Размер сегмента для очереди MPMC из capacity ячеек
+static inline size_t mpmc_size(uint32_t capacity) {
+    return sizeof(shm_data_t) + (size_t)capacity * sizeof(mpmc_cell_t);
+}
+
+// Размер сегмента с байтовым кольцом на capacity байт
+static inline size_t bytes_size(uint64_t capacity) {
+    return sizeof(shm_data_t) + capacity;
+}
+
+// Сколько места в кольце занимает запись с сообщением длины len
+static inline uint64_t bytes_record_size(uint64_t len) {
+    return (sizeof(bytes_hdr_t) + len + CACHE_LINE - 1) & ~(uint64_t)(CACHE_LINE - 1);
+}
+
+// Заголовок записи по позиции в байтовом кольце
+static inline volatile bytes_hdr_t *bytes_hdr(volatile shm_data_t *shm, uint64_t pos) {
+    return (volatile bytes_hdr_t *)((volatile unsigned char *)shm->slots + (pos & shm->mask));
+}
+
+// Текущее время в наносекундах (монотонные часы, общие для всех процессов)
+static inline long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Спать, пока *addr == expected. Futex без FUTEX_PRIVATE_FLAG работает между процессами.
+static inline int futex_wait(volatile uint32_t *addr, uint32_t expected) {
+    return syscall(SYS_futex, addr, FUTEX_WAIT, expected, NULL, NULL, 0);
+}
+
+// Разбудить всех, кто спит на addr
+static inline int futex_wake(volatile uint32_t *addr) {
+    return syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+// Сменить futex-слово и разбудить ожидающих (используется и при завершении)
+static inline void futex_bump(volatile uint32_t *addr) {
+    __atomic_add_fetch(addr, 1, __ATOMIC_RELEASE);
+    futex_wake(addr);
+}
+
+// Спать, пока *addr == expected, но не дольше ms миллисекунд
+static inline int futex_wait_ms(volatile uint32_t *addr, uint32_t expected, long ms) {
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000 };
+    return syscall(SYS_futex, addr, FUTEX_WAIT, expected, &ts, NULL, 0);
+}
+
+// Положить сообщение в кольцо (только клиент). Если кольцо заполнено, клиент спит
+// в futex до освобождения места. Возвращает -1, если установлен terminate.
+static inline int ring_push(volatile shm_data_t *shm, const shm_msg_t *msg, uint64_t *cached_tail) {
+    uint64_t head = shm->head; // head меняет только клиент
+    while (head - *cached_tail >= shm->capacity) {
+        *cached_tail = __atomic_load_n(&shm->tail, __ATOMIC_ACQUIRE);
+        if (head - *cached_tail < shm->capacity)
+            break;
+        if (shm->terminate)
+            return -1;
+        // Объявляем, что спим, и перепроверяем tail: сервер либо увидит флаг,
+        // либо мы увидим новый tail - потерять пробуждение нельзя
+        uint32_t w = __atomic_load_n(&shm->space_seq, __ATOMIC_ACQUIRE);
+        __atomic_store_n(&shm->producer_waiting, 1, __ATOMIC_SEQ_CST);
+        *cached_tail = __atomic_load_n(&shm->tail, __ATOMIC_SEQ_CST);
+        if (head - *cached_tail >= shm->capacity && !shm->terminate)
+            futex_wait(&shm->space_seq, w);
+        __atomic_store_n(&shm->producer_waiting, 0, __ATOMIC_RELAXED);
+    }
+
+    shm->slots[head & shm->mask] = *msg;
+    __atomic_store_n(&shm->head, head + 1, __ATOMIC_SEQ_CST); // данные ячейки видны раньше head
+
+    // Будим сервер, только если он действительно спит - иначе системного вызова нет
+    if (__atomic_load_n(&shm->consumer_waiting, __ATOMIC_SEQ_CST))
+        futex_bump(&shm->data_seq);
+    return 0;
+}
+
+// Забрать сообщение из кольца (только сервер). Если кольцо пустое, сервер спит в futex.
+// Возвращает -1, когда установлен terminate и все сообщения уже прочитаны.
+static inline int ring_pop(volatile shm_data_t *shm, shm_msg_t *msg, uint64_t *cached_head) {
+    uint64_t tail = shm->tail; // tail меняет только сервер
+    while (tail == *cached_head) {
+        *cached_head = __atomic_load_n(&shm->head, __ATOMIC_ACQUIRE);
+        if (tail != *cached_head)
+            break;
+        // Клиент мог положить последнее сообщение и поставить terminate уже после чтения
+        // head, поэтому после terminate head перечитывается: кольцо дочитывается до конца
+        if (__atomic_load_n(&shm->terminate, __ATOMIC_ACQUIRE)) {
+            *cached_head = __atomic_load_n(&shm->head, __ATOMIC_ACQUIRE);
+            if (tail == *cached_head)
+                return -1;
+            break;
+        }
+        uint32_t w = __atomic_load_n(&shm->data_seq, __ATOMIC_ACQUIRE);
+        __atomic_store_n(&shm->consumer_waiting, 1, __ATOMIC_SEQ_CST);
+        *cached_head = __atomic_load_n(&shm->head, __ATOMIC_SEQ_CST);
+        if (tail == *cached_head && !shm->terminate)
+            futex_wait(&shm->data_seq, w);
+        __atomic_store_n(&shm->consumer_waiting, 0, __ATOMIC_RELAXED);
+    }
+
+    *msg = shm->slots[tail & shm->mask];
+    __atomic_store_n(&shm->tail, tail + 1, __ATOMIC_SEQ_CST); // ячейка прочитана до сдвига tail
+
+    if (__atomic_load_n(&shm->producer_waiting, __ATOMIC_SEQ_CST))
+        futex_bump(&shm->space_seq);
+    return 0;
+}
+
+// Опубликовать запись (только клиент). Писатель никогда не ждёт читателей:
+// seq становится нечётным, запись копируется, seq становится чётным.
+static inline void seqlock_publish(volatile shm_data_t *shm, const shm_record_t *rec) {
+    uint32_t seq = shm->rec_seq;
+    __atomic_store_n(&shm->rec_seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE); // нечётный seq виден раньше новых данных
+    shm->record = *rec;
+    __atomic_store_n(&shm->rec_seq, seq + 2, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&shm->record_waiting, __ATOMIC_SEQ_CST))
+        futex_wake(&shm->rec_seq);
+}
+
+// Прочитать согласованный снимок записи (сервер). Если во время чтения клиент начал
+// новую запись, чтение повторяется; число повторов добавляется в *retries.
+// Возвращает номер версии (чётный seq) прочитанного снимка.
+static inline uint32_t seqlock_read(volatile shm_data_t *shm, shm_record_t *rec, long long *retries) {
+    for (unsigned spins = 1;; spins++) {
+        uint32_t s1 = __atomic_load_n(&shm->rec_seq, __ATOMIC_ACQUIRE);
+        if (s1 & 1) {
+            (*retries)++; // клиент как раз пишет
+            // Клиента могли вытеснить посреди записи - отдаём ему процессор
+            if (spins % 64 == 0)
+                sched_yield();
+            continue;
+        }
+        *rec = shm->record;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE); // данные прочитаны раньше повторной проверки seq
+        uint32_t s2 = __atomic_load_n(&shm->rec_seq, __ATOMIC_RELAXED);
+        if (s1 == s2)
+            return s1;
+        (*retries)++;
+    }
+}
+
+// Ждать, пока версия записи не станет отличной от last (или не придёт terminate)
+static inline void seqlock_wait(volatile shm_data_t *shm, uint32_t last) {
+    while (__atomic_load_n(&shm->rec_seq, __ATOMIC_ACQUIRE) == last && !shm->terminate) {
+        __atomic_store_n(&shm->record_waiting, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&shm->rec_seq, __ATOMIC_SEQ_CST) == last && !shm->terminate)
+            futex_wait(&shm->rec_seq, last);
+        __atomic_store_n(&shm->record_waiting, 0, __ATOMIC_RELAXED);
+    }
+}
+
+// Попытка положить сообщение в очередь MPMC (любой клиент). Клиент занимает позицию head
+// через CAS, пишет ячейку и отдаёт её серверам, сдвигая turn. Возвращает -1, если очередь полна.
+static inline int mpmc_try_push(volatile shm_data_t *shm, const shm_msg_t *msg) {
+    volatile mpmc_cell_t *cells = mpmc_cells(shm);
+    uint64_t pos = __atomic_load_n(&shm->head, __ATOMIC_RELAXED);
+    while (1) {
+        volatile mpmc_cell_t *cell = &cells[pos & shm->mask];
+        uint64_t turn = __atomic_load_n(&cell->turn, __ATOMIC_ACQUIRE);
+        int64_t diff = (int64_t)(turn - pos);
+        if (diff == 0) {
+            // При неудаче CAS запишет в pos текущий head
+            if (__atomic_compare_exchange_n(&shm->head, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                cell->msg = *msg;
+                __atomic_store_n(&cell->turn, pos + 1, __ATOMIC_RELEASE);
+                return 0;
+            }
+        } else if (diff < 0) {
+            return -1; // ячейку ещё не освободил сервер, отставший на круг
+        } else {
+            pos = __atomic_load_n(&shm->head, __ATOMIC_RELAXED); // позицию занял другой клиент
+        }
+    }
+}
+
+// Попытка забрать сообщение из очереди MPMC (любой сервер). Возвращает -1, если очередь пуста.
+static inline int mpmc_try_pop(volatile shm_data_t *shm, shm_msg_t *msg) {
+    volatile mpmc_cell_t *cells = mpmc_cells(shm);
+    uint64_t pos = __atomic_load_n(&shm->tail, __ATOMIC_RELAXED);
+    while (1) {
+        volatile mpmc_cell_t *cell = &cells[pos & shm->mask];
+        uint64_t turn = __atomic_load_n(&cell->turn, __ATOMIC_ACQUIRE);
+        int64_t diff = (int64_t)(turn - (pos + 1));
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&shm->tail, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                *msg = cell->msg;
+                // Ячейка свободна для записи на следующем круге
+                __atomic_store_n(&cell->turn, pos + shm->mask + 1, __ATOMIC_RELEASE);
+                return 0;
+            }
+        } else if (diff < 0) {
+            return -1;
+        } else {
+            pos = __atomic_load_n(&shm->tail, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// Положить сообщение в очередь MPMC; если очередь полна, клиент спит на space_seq.
+// Возвращает -1, если установлен terminate.
+static inline int mpmc_push(volatile shm_data_t *shm, const shm_msg_t *msg) {
+    while (mpmc_try_push(shm, msg) < 0) {
+        if (shm->terminate)
+            return -1;
+        // Спящих клиентов может быть несколько, поэтому флаг - счётчик
+        uint32_t w = __atomic_load_n(&shm->space_seq, __ATOMIC_ACQUIRE);
+        __atomic_add_fetch(&shm->producer_waiting, 1, __ATOMIC_SEQ_CST);
+        int pushed = mpmc_try_push(shm, msg) == 0;
+        if (!pushed && !shm->terminate)
+            futex_wait(&shm->space_seq, w);
+        __atomic_sub_fetch(&shm->producer_waiting, 1, __ATOMIC_RELAXED);
+        if (pushed)
+            break;
+    }
+
+    // Запись ячейки должна стать видна раньше, чем мы прочитаем счётчик спящих
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&shm->consumer_waiting, __ATOMIC_RELAXED))
+        futex_bump(&shm->data_seq);
+    return 0;
+}
+
+// Забрать сообщение из очереди MPMC; если очередь пуста, сервер спит на data_seq.
+// Возвращает -1, когда установлен terminate и очередь пуста.
+static inline int mpmc_pop(volatile shm_data_t *shm, shm_msg_t *msg) {
+    while (mpmc_try_pop(shm, msg) < 0) {
+        // Последнее сообщение могли положить между неудачной попыткой и чтением terminate,
+        // поэтому после terminate очередь проверяется ещё раз
+        if (__atomic_load_n(&shm->terminate, __ATOMIC_ACQUIRE)) {
+            if (mpmc_try_pop(shm, msg) == 0)
+                break;
+            return -1;
+        }
+        uint32_t w = __atomic_load_n(&shm->data_seq, __ATOMIC_ACQUIRE);
+        __atomic_add_fetch(&shm->consumer_waiting, 1, __ATOMIC_SEQ_CST);
+        int popped = mpmc_try_pop(shm, msg) == 0;
+        if (!popped && !shm->terminate)
+            futex_wait(&shm->data_seq, w);
+        __atomic_sub_fetch(&shm->consumer_waiting, 1, __ATOMIC_RELAXED);
+        if (popped)
+            break;
+    }
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&shm->producer_waiting, __ATOMIC_RELAXED))
+        futex_bump(&shm->space_seq);
+    return 0;
+}
+
+// Подключить сервер к широковещательному кольцу: занять свободную строку таблицы.
+// Читатель начинает с текущего head, то есть видит только новые сообщения.
+// Возвращает номер строки или -1, если таблица заполнена.
+static inline int bcast_attach(volatile shm_data_t *shm) {
+    for (int i = 0; i < MAX_READERS; i++) {
+        volatile reader_t *r = &shm->readers[i];
+        uint32_t expected = 0;
+        if (__atomic_compare_exchange_n(&r->active, &expected, 2, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            r->pid = getpid();
+            r->cursor = __atomic_load_n(&shm->head, __ATOMIC_ACQUIRE);
+            __atomic_store_n(&r->active, 1, __ATOMIC_SEQ_CST);
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Отключить сервер: клиент перестаёт его ждать
+static inline void bcast_detach(volatile shm_data_t *shm, int id) {
+    __atomic_store_n(&shm->readers[id].active, 0, __ATOMIC_RELEASE);
+    futex_bump(&shm->space_seq);
+}
+
+// Курсор самого медленного подключённого читателя (head, если читателей нет).
+// При reap строки умерших серверов освобождаются.
+static inline uint64_t bcast_min_cursor(volatile shm_data_t *shm, uint64_t head, int reap) {
+    uint64_t min = head;
+    for (int i = 0; i < MAX_READERS; i++) {
+        volatile reader_t *r = &shm->readers[i];
+        if (__atomic_load_n(&r->active, __ATOMIC_ACQUIRE) != 1)
+            continue;
+        if (reap && kill(r->pid, 0) == -1 && errno == ESRCH) {
+            __atomic_store_n(&r->active, 0, __ATOMIC_RELEASE);
+            continue;
+        }
+        uint64_t c = __atomic_load_n(&r->cursor, __ATOMIC_ACQUIRE);
+        if (c < min)
+            min = c;
+    }
+    return min;
+}
+
+// Опубликовать сообщение для всех читателей (только клиент). Без overwrite клиент ждёт,
+// пока самый медленный читатель не освободит ячейку; *cached_min - его последний известный курсор.
+// Ячейка помечается SLOT_BUSY на время записи, поэтому отставший читатель видит затирание.
+// Возвращает -1, если установлен terminate.
+static inline int bcast_push(volatile shm_data_t *shm, shm_msg_t *msg, uint64_t *cached_min) {
+    uint64_t head = shm->head;
+    while (!shm->overwrite && head - *cached_min >= shm->capacity) {
+        *cached_min = bcast_min_cursor(shm, head, 0);
+        if (head - *cached_min < shm->capacity)
+            break;
+        if (shm->terminate)
+            return -1;
+        uint32_t w = __atomic_load_n(&shm->space_seq, __ATOMIC_ACQUIRE);
+        __atomic_store_n(&shm->producer_waiting, 1, __ATOMIC_SEQ_CST);
+        *cached_min = bcast_min_cursor(shm, head, 0);
+        // Ждём с таймаутом: медленный сервер мог умереть, не отключившись
+        if (head - *cached_min >= shm->capacity && !shm->terminate &&
+            futex_wait_ms(&shm->space_seq, w, 100) == -1 && errno == ETIMEDOUT)
+            *cached_min = bcast_min_cursor(shm, head, 1);
+        __atomic_store_n(&shm->producer_waiting, 0, __ATOMIC_RELAXED);
+    }
+
+    volatile shm_msg_t *slot = &shm->slots[head & shm->mask];
+    msg->seq = head;
+    __atomic_store_n(&slot->seq, SLOT_BUSY, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE); // метка видна раньше новых данных
+    slot->value = msg->value;
+    slot->producer = msg->producer;
+    slot->sent_ns = msg->sent_ns;
+    __atomic_store_n(&slot->seq, head, __ATOMIC_RELEASE);
+    __atomic_store_n(&shm->head, head + 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&shm->consumer_waiting, __ATOMIC_SEQ_CST))
+        futex_bump(&shm->data_seq);
+    return 0;
+}
+
+// Прочитать следующее сообщение читателем id. Если клиент затёр непрочитанные сообщения
+// (режим overwrite), курсор перескакивает вперёд, а число пропущенных добавляется в *lost.
+// Возвращает -1, когда установлен terminate и всё прочитано.
+static inline int bcast_pop(volatile shm_data_t *shm, int id, shm_msg_t *msg, uint64_t *lost) {
+    volatile reader_t *r = &shm->readers[id];
+    uint64_t cursor = r->cursor; // курсор меняет только сам читатель
+    while (1) {
+        uint64_t head = __atomic_load_n(&shm->head, __ATOMIC_ACQUIRE);
+        if (head == cursor) {
+            // После terminate head перечитывается: клиент мог положить последнее
+            // сообщение уже после первого чтения head
+            if (__atomic_load_n(&shm->terminate, __ATOMIC_ACQUIRE)) {
+                if (__atomic_load_n(&shm->head, __ATOMIC_ACQUIRE) == cursor)
+                    return -1;
+                continue;
+            }
+            // Несколько серверов могут спать одновременно - считаем их
+            uint32_t w = __atomic_load_n(&shm->data_seq, __ATOMIC_ACQUIRE);
+            __atomic_add_fetch(&shm->consumer_waiting, 1, __ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&shm->head, __ATOMIC_SEQ_CST) == cursor && !shm->terminate)
+                futex_wait(&shm->data_seq, w);
+            __atomic_sub_fetch(&shm->consumer_waiting, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        volatile shm_msg_t *slot = &shm->slots[cursor & shm->mask];
+        uint64_t s1 = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if (s1 == cursor) {
+            msg->seq = cursor;
+            msg->value = slot->value;
+            msg->producer = slot->producer;
+            msg->sent_ns = slot->sent_ns;
+            __atomic_thread_fence(__ATOMIC_ACQUIRE); // данные прочитаны раньше повторной проверки
+            if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == cursor)
+                break;
+        }
+        // Ячейку уже затёрло сообщение следующего круга: догоняем клиента
+        uint64_t next = head > shm->capacity ? head - shm->capacity + 1 : cursor + 1;
+        if (next <= cursor)
+            next = cursor + 1;
+        *lost += next - cursor;
+        cursor = next;
+    }
+
+    __atomic_store_n(&r->cursor, cursor + 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&shm->producer_waiting, __ATOMIC_SEQ_CST))
+        futex_bump(&shm->space_seq);
+    return 0;
+}
+
+// Ждать в байтовом кольце (только клиент), пока не освободится need байт
+static inline int bytes_wait_space(volatile shm_data_t *shm, uint64_t need, uint64_t *cached_tail) {
+    uint64_t head = shm->head;
+    while (shm->capacity - (head - *cached_tail) < need) {
+        *cached_tail = __atomic_load_n(&shm->tail, __ATOMIC_ACQUIRE);
+        if (shm->capacity - (head - *cached_tail) >= need)
+            break;
+        if (shm->terminate)
+            return -1;
+        uint32_t w = __atomic_load_n(&shm->space_seq, __ATOMIC_ACQUIRE);
+        __atomic_store_n(&shm->producer_waiting, 1, __ATOMIC_SEQ_CST);
+        *cached_tail = __atomic_load_n(&shm->tail, __ATOMIC_SEQ_CST);
+        if (shm->capacity - (head - *cached_tail) < need && !shm->terminate)
+            futex_wait(&shm->space_seq, w);
+        __atomic_store_n(&shm->producer_waiting, 0, __ATOMIC_RELAXED);
+    }
+    return 0;
+}
+
+// Сдвинуть head и разбудить сервер, если он спит
+static inline void bytes_publish(volatile shm_data_t *shm, uint64_t head) {
+    __atomic_store_n(&shm->head, head, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&shm->consumer_waiting, __ATOMIC_SEQ_CST))
+        futex_bump(&shm->data_seq);
+}
+
+// Зарезервировать в байтовом кольце место под сообщение длины до len (только клиент).
+// Возвращает адрес, куда клиент пишет сообщение прямо в сегменте, или NULL, если
+// сообщение больше кольца (errno = EMSGSIZE) или установлен terminate.
+// Если до конца области сообщение не помещается, там публикуется заполнитель.
+static inline void *bytes_reserve(volatile shm_data_t *shm, uint64_t len, uint64_t *cached_tail) {
+    uint64_t need = bytes_record_size(len);
+    if (need > shm->capacity) {
+        errno = EMSGSIZE;
+        return NULL;
+    }
+    uint64_t head = shm->head;
+    uint64_t to_end = shm->capacity - (head & shm->mask);
+    if (need > to_end) {
+        if (bytes_wait_space(shm, to_end, cached_tail) < 0)
+            return NULL;
+        volatile bytes_hdr_t *pad = bytes_hdr(shm, head);
+        pad->len = to_end;
+        pad->type = REC_PAD;
+        head += to_end;
+        bytes_publish(shm, head);
+    }
+    if (bytes_wait_space(shm, need, cached_tail) < 0)
+        return NULL;
+    return (unsigned char *)bytes_hdr(shm, head) + sizeof(bytes_hdr_t);
+}
+
+// Опубликовать сообщение, записанное по адресу из bytes_reserve (только клиент).
+// len может быть меньше зарезервированного.
+static inline void bytes_commit(volatile shm_data_t *shm, uint64_t len, uint64_t seq) {
+    uint64_t head = shm->head;
+    volatile bytes_hdr_t *hdr = bytes_hdr(shm, head);
+    hdr->len = len;
+    hdr->type = REC_DATA;
+    hdr->seq = seq;
+    hdr->sent_ns = now_ns();
+    bytes_publish(shm, head + bytes_record_size(len)); // сообщение видно раньше head
+}
+
+// Получить следующее сообщение байтового кольца (только сервер). Сообщение не копируется:
+// возвращается его адрес в сегменте, действительный до bytes_release.
+// Возвращает NULL, когда установлен terminate и все сообщения прочитаны.
+static inline const void *bytes_peek(volatile shm_data_t *shm, bytes_hdr_t *info, uint64_t *cached_head) {
+    while (1) {
+        uint64_t tail = shm->tail;
+        while (tail == *cached_head) {
+            *cached_head = __atomic_load_n(&shm->head, __ATOMIC_ACQUIRE);
+            if (tail != *cached_head)
+                break;
+            // Как в ring_pop: после terminate head перечитывается, чтобы дочитать кольцо
+            if (__atomic_load_n(&shm->terminate, __ATOMIC_ACQUIRE)) {
+                *cached_head = __atomic_load_n(&shm->head, __ATOMIC_ACQUIRE);
+                if (tail == *cached_head)
+                    return NULL;
+                break;
+            }
+            uint32_t w = __atomic_load_n(&shm->data_seq, __ATOMIC_ACQUIRE);
+            __atomic_store_n(&shm->consumer_waiting, 1, __ATOMIC_SEQ_CST);
+            *cached_head = __atomic_load_n(&shm->head, __ATOMIC_SEQ_CST);
+            if (tail == *cached_head && !shm->terminate)
+                futex_wait(&shm->data_seq, w);
+            __atomic_store_n(&shm->consumer_waiting, 0, __ATOMIC_RELAXED);
+        }
+
+        volatile bytes_hdr_t *hdr = bytes_hdr(shm, tail);
+        if (hdr->type == REC_DATA) {
+            info->len = hdr->len;
+            info->type = hdr->type;
+            info->seq = hdr->seq;
+            info->sent_ns = hdr->sent_ns;
+            return (const unsigned char *)hdr + sizeof(bytes_hdr_t);
+        }
+        // Заполнитель: сразу освобождаем и переходим к началу области
+        __atomic_store_n(&shm->tail, tail + hdr->len, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&shm->producer_waiting, __ATOMIC_SEQ_CST))
+            futex_bump(&shm->space_seq);
+    }
+}
+
+// Освободить сообщение, полученное через bytes_peek (только сервер)
+static inline void bytes_release(volatile shm_data_t *shm) {
+    uint64_t tail = shm->tail;
+    __atomic_store_n(&shm->tail, tail + bytes_record_size(bytes_hdr(shm, tail)->len), __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&shm->producer_waiting, __ATOMIC_SEQ_CST))
+        futex_bump(&shm->space_seq);
+}
+
+#endif
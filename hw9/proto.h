@@ -0,0 +1,82 @@
+#ifndef PROTO_H
+#define PROTO_H
+
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+// Сигналы пословной передачи. Из нескольких ожидающих RT-сигналов ядро доставляет
+// сигнал с меньшим номером первым, поэтому начало передачи имеет самый маленький номер,
+// а конец - самый большой: он не обгонит ещё не доставленные слова.
+#define SIG_START (SIGRTMIN)     // Начало передачи, значение - ширина слова и размер окна
+#define SIG_WORD  (SIGRTMIN + 1) // Слово, значение - само слово
+#define SIG_END   (SIGRTMIN + 2) // Конец передачи, значение - число слов; приёмник отвечает тем же
+#define SIG_ACK   (SIGRTMIN + 3) // Накопительное подтверждение окна: сколько слов принято по порядку
+#define SIG_BIT   (SIGRTMIN + 4) // Побитовая передача на RT-сигналах: значение - (номер << 1) | бит, SIG_ACK - номер
+#define SIG_BULK  (SIGRTMIN + 5) // Передача буфера: первый сигнал - способ и длина, второй - адрес или дескриптор
+
+// Значение SIG_START: младший байт - ширина слова, выше - размер окна (0 - без окна).
+// С окном слово 32-битное, а в старших 32 битах sival_ptr идёт номер слова.
+#define START_VALUE(width, window) ((width) | ((window) << 8))
+#define START_WIDTH(v) ((v) & 0xff)
+#define START_WINDOW(v) ((v) >> 8)
+#define PACK_SEQ(seq, word) ((void *)(uintptr_t)(((uint64_t)(seq) << 32) | (uint32_t)(word)))
+#define SEQ_OF(p) ((uint32_t)((uint64_t)(uintptr_t)(p) >> 32))
+#define WORD_OF(p) ((uint32_t)(uintptr_t)(p))
+#define BIT_VALUE(seq, bit) ((int)(((uint32_t)(seq) << 1) | (bit)))
+#define BIT_SEQ(v) ((uint32_t)(v) >> 1)
+#define BIT_OF(v) ((v) & 1)
+
+// Способ передачи буфера: приёмник читает память передатчика (process_vm_readv)
+// или получает копию его дескриптора (pidfd_getfd). Способ - в старшем байте значения, длина - ниже.
+enum { BULK_VM = 1, BULK_FD = 2 };
+#define BULK_VALUE(kind, len) ((void *)(uintptr_t)(((uint64_t)(kind) << 56) | (uint64_t)(len)))
+#define BULK_KIND(p) ((int)((uint64_t)(uintptr_t)(p) >> 56))
+#define BULK_LEN(p) ((uint64_t)(uintptr_t)(p) & ((1ULL << 56) - 1))
+
+// Контрольная сумма буфера для сверки: сумма 64-битных слов, хвост дополняется нулями.
+// Буфер можно считать по частям, если длина всех частей, кроме последней, кратна 8.
+static inline uint64_t bulk_checksum(uint64_t sum, const void *buf, uint64_t len) {
+    const unsigned char *p = buf;
+    uint64_t w;
+    for (; len >= 8; p += 8, len -= 8) {
+        memcpy(&w, p, 8);
+        sum += w;
+    }
+    if (len) {
+        w = 0;
+        memcpy(&w, p, len);
+        sum += w;
+    }
+    return sum;
+}
+
+// Отправить RT-сигнал со значением. Очередь RT-сигналов ограничена (RLIMIT_SIGPENDING):
+// если она заполнена, ждём, пока приёмник разберёт сигналы. Возвращает -1 при ошибке.
+static inline int queue_signal(pid_t pid, int sig, union sigval v) {
+    for (int tries = 1; sigqueue(pid, sig, v) == -1; tries++) {
+        if (errno != EAGAIN)
+            return -1;
+        // Очередь общая для всех процессов пользователя: если она долго заполнена,
+        // не отнимаем процессор у приёмника, который её разбирает
+        if (tries % 16 == 0) {
+            struct timespec pause = { 0, 100000 };
+            nanosleep(&pause, NULL);
+        } else {
+            sched_yield();
+        }
+    }
+    return 0;
+}
+
+// Текущее время в наносекундах (clock_gettime можно вызывать и в обработчике сигнала)
+static inline long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+#endif
@@ -1,8 +1,18 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <signal.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#include "proto.h"
 
 // Флаг завершения приёма
 volatile sig_atomic_t done = 0;
@@ -20,6 +30,107 @@ void handle_bit(int sig) {
         kill(pid, SIGUSR1);
 }
 
+// Пословная передача
+volatile int word_width = 0;          // Ширина слова из SIG_START, 0 - передача побитовая
+volatile uint64_t words = 0;          // Сколько слов принято
+volatile uint64_t words_sum = 0;      // Сумма слов - для сверки с отправителем
+volatile uint64_t words_expected = 0; // Сколько слов отправитель объявил в SIG_END
+volatile long long start_ns = 0, end_ns = 0;
+volatile uint32_t window = 0;         // Размер окна из SIG_START, 0 - без подтверждений
+volatile uint32_t ack_every = 1;      // Подтверждать каждые ack_every слов
+volatile uint64_t out_of_order = 0;   // Слова с неожиданным номером
+// Принятые слова для печати: обработчик дописывает, main печатает
+#define SEEN_SIZE 1024
+volatile uint64_t seen[SEEN_SIZE];
+
+// Побитовая передача на RT-сигналах с номерами битов
+volatile uint32_t rt_bits = 0;      // Сколько битов принято по порядку (номер ожидаемого бита)
+volatile uint64_t duplicates = 0;   // Повторно присланные биты
+volatile uint64_t lost = 0;         // Сколько битов и подтверждений выброшено имитацией потерь
+int loss_percent = 0;               // -l: вероятность потери в процентах
+uint32_t rand_state = 1;
+
+// Передача буфера: способ и длина из первого SIG_BULK, адрес или дескриптор - из второго
+volatile int bulk_kind = 0;
+volatile uint64_t bulk_len = 0;
+volatile uintptr_t bulk_ref = 0;
+
+// Имитация потерь: xorshift, чтобы не вызывать rand() в обработчике сигнала
+static int lose(void) {
+    if (!loss_percent)
+        return 0;
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    if (rand_state % 100 >= (uint32_t)loss_percent)
+        return 0;
+    lost++;
+    return 1;
+}
+
+// Обработчик RT-сигналов пословной передачи (SA_SIGINFO - значение приходит в si_value)
+void handle_word(int sig, siginfo_t *si, void *ctx) {
+    (void)ctx;
+    if (sig == SIG_START) {
+        word_width = START_WIDTH(si->si_value.sival_int);
+        window = START_WINDOW(si->si_value.sival_int);
+        // Подтверждение на каждую половину окна: в заполненном окне всегда найдётся
+        // номер, после которого уйдёт подтверждение
+        ack_every = window > 1 ? window / 2 : 1;
+        words = words_sum = out_of_order = 0;
+        start_ns = now_ns();
+    } else if (sig == SIG_WORD && window) {
+        void *p = si->si_value.sival_ptr;
+        if (SEQ_OF(p) != (uint32_t)words) {
+            out_of_order++;
+            return;
+        }
+        uint64_t w = WORD_OF(p);
+        seen[words % SEEN_SIZE] = w;
+        words_sum += w;
+        words++;
+        if (words % ack_every == 0) {
+            union sigval v = { .sival_ptr = (void *)(uintptr_t)words };
+            sigqueue(pid, SIG_ACK, v); // sigqueue можно вызывать в обработчике
+        }
+    } else if (sig == SIG_BIT) {
+        if (lose())
+            return; // бит "потерялся" - передатчик пришлёт его снова по таймауту
+        uint32_t seq = BIT_SEQ(si->si_value.sival_int);
+        if (seq == rt_bits) {
+            value = (value << 1) | (uint32_t)BIT_OF(si->si_value.sival_int);
+            rt_bits++;
+        } else if (seq < rt_bits) {
+            duplicates++; // потерялось подтверждение: бит уже принят, только подтверждаем
+        } else {
+            return;
+        }
+        if (lose())
+            return;
+        union sigval v = { .sival_int = (int)seq };
+        sigqueue(pid, SIG_ACK, v);
+    } else if (sig == SIG_BULK) {
+        if (!bulk_kind) {
+            bulk_kind = BULK_KIND(si->si_value.sival_ptr);
+            bulk_len = BULK_LEN(si->si_value.sival_ptr);
+            start_ns = now_ns();
+        } else {
+            bulk_ref = (uintptr_t)si->si_value.sival_ptr;
+            done = 1;
+        }
+    } else if (sig == SIG_WORD) {
+        uint64_t w = word_width == 64 ? (uint64_t)(uintptr_t)si->si_value.sival_ptr
+                                      : (uint32_t)si->si_value.sival_int;
+        seen[words % SEEN_SIZE] = w;
+        words_sum += w;
+        words++;
+    } else {
+        words_expected = (uintptr_t)si->si_value.sival_ptr;
+        end_ns = now_ns();
+        done = 1;
+    }
+}
+
 // Обработчик сигнала SIGINT
 void handle_end(int sig) {
     (void)sig;
@@ -33,9 +144,377 @@ void print_bits32(uint32_t u) {
     putchar('\n');
 }
 
-int main(void) {
+// Забрать буфер передатчика. BULK_VM - process_vm_readv читает память передатчика кусками
+// прямо в буфер приёмника, BULK_FD - pidfd_getfd даёт копию дескриптора передатчика, и файл
+// отображается в память приёмника без копирования. out_path - куда записать данные (или NULL).
+// Возвращает число полученных байт.
+uint64_t receive_bulk(const char *out_path, uint64_t *sum) {
+    int out = -1;
+    if (out_path && (out = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1)
+        perror(out_path);
+    uint64_t got = 0;
+    *sum = 0;
+
+    if (bulk_kind == BULK_VM) {
+        // Кусок кратен 8 для контрольной суммы и помещается в кэш
+        size_t chunk = 1 << 20;
+        char *buf = malloc(chunk);
+        while (buf && got < bulk_len) {
+            size_t n = bulk_len - got < chunk ? bulk_len - got : chunk;
+            struct iovec local = { buf, n };
+            struct iovec remote = { (void *)(bulk_ref + got), n };
+            ssize_t r = process_vm_readv(pid, &local, 1, &remote, 1, 0);
+            if (r <= 0) {
+                perror("process_vm_readv");
+                break;
+            }
+            *sum = bulk_checksum(*sum, buf, r);
+            if (out != -1 && write(out, buf, r) != r)
+                perror("write");
+            got += r;
+        }
+        free(buf);
+    } else {
+        int pidfd = syscall(SYS_pidfd_open, pid, 0);
+        int fd = pidfd == -1 ? -1 : syscall(SYS_pidfd_getfd, pidfd, (int)bulk_ref, 0);
+        if (fd == -1) {
+            perror("pidfd_getfd");
+        } else if (bulk_len) {
+            char *buf = mmap(NULL, bulk_len, PROT_READ, MAP_SHARED | MAP_POPULATE, fd, 0);
+            if (buf == MAP_FAILED) {
+                perror("mmap");
+            } else {
+                *sum = bulk_checksum(0, buf, bulk_len);
+                if (out != -1 && write(out, buf, bulk_len) != (ssize_t)bulk_len)
+                    perror("write");
+                got = bulk_len;
+                munmap(buf, bulk_len);
+            }
+        }
+        if (fd != -1)
+            close(fd);
+        if (pidfd != -1)
+            close(pidfd);
+    }
+    if (out != -1)
+        close(out);
+    return got;
+}
+
+// Режим сервера (-s): один приёмник обслуживает много передатчиков сразу.
+// Сигналы читаются из signalfd в цикле epoll, а по ssi_pid каждый сигнал попадает
+// в состояние своего передатчика, поэтому биты разных передатчиков не смешиваются.
+#define MAX_SENDERS 4096 // Размер таблицы передатчиков (степень двойки)
+
+enum { PROTO_BITS, PROTO_RT_BITS, PROTO_WORDS };
+
+// Состояние одного передатчика
+typedef struct {
+    pid_t pid;            // 0 - строка свободна, -1 - строка освобождена (поиск идёт дальше)
+    int proto;            // PROTO_BITS, PROTO_RT_BITS или PROTO_WORDS
+    uint32_t bits;        // Побитовая передача: принятые биты и их число
+    int nbits;
+    int width;            // Пословная передача: ширина слова, окно, подтверждение
+    uint32_t window, ack_every;
+    uint64_t words, sum, out_of_order; // out_of_order - ещё и повторы битов
+    long long start_ns;
+    int reply_sig;        // Отложенный ответ: очередь сигналов была заполнена
+    union sigval reply_val;
+    int finished;         // Передача закончена, строка освобождается после ответа
+} sender_state_t;
+
+static sender_state_t senders[MAX_SENDERS];
+static int active = 0;
+static int tombstones = 0;      // Сколько строк освобождено (pid = -1)
+static int pending_replies = 0; // Сколько передатчиков ждут отложенного ответа
+
+// Перестроить таблицу без освобождённых строк. Вызывается только при заведении нового
+// передатчика, когда указателей на строки ни у кого нет.
+static void rehash_senders(void) {
+    static sender_state_t old[MAX_SENDERS];
+    memcpy(old, senders, sizeof(senders));
+    memset(senders, 0, sizeof(senders));
+    for (int j = 0; j < MAX_SENDERS; j++) {
+        if (old[j].pid <= 0)
+            continue;
+        unsigned i = (unsigned)old[j].pid * 2654435761u;
+        while (senders[i & (MAX_SENDERS - 1)].pid != 0)
+            i++;
+        senders[i & (MAX_SENDERS - 1)] = old[j];
+    }
+    tombstones = 0;
+}
+
+// Найти состояние передатчика pid (открытая адресация); create - завести, если его нет
+static sender_state_t *find_sender(pid_t p, int create) {
+    // Освобождённые строки удлиняют поиск: когда их много, таблица перестраивается
+    if (create && tombstones > MAX_SENDERS / 4)
+        rehash_senders();
+    sender_state_t *free_slot = NULL;
+    for (unsigned i = 0, h = (unsigned)p * 2654435761u; i < MAX_SENDERS; i++) {
+        sender_state_t *st = &senders[(h + i) & (MAX_SENDERS - 1)];
+        if (st->pid == p)
+            return st;
+        if (st->pid == -1 && !free_slot)
+            free_slot = st;
+        if (st->pid == 0) {
+            if (!free_slot)
+                free_slot = st;
+            break;
+        }
+    }
+    if (!create || !free_slot)
+        return NULL;
+    tombstones -= free_slot->pid == -1;
+    memset(free_slot, 0, sizeof(*free_slot));
+    free_slot->pid = p;
+    free_slot->start_ns = now_ns();
+    active++;
+    return free_slot;
+}
+
+// Освободить строку. Если следующая строка пустая, цепочка поиска здесь кончается и ни один
+// поиск через эту строку дальше не идёт: она и освобождённые строки перед ней снова
+// становятся пустыми. Остальные освобождённые строки убирает rehash_senders.
+static void remove_sender(sender_state_t *st) {
+    unsigned i = st - senders;
+    if (st->reply_sig) {
+        // Отложенный ответ уходит вместе со строкой
+        st->reply_sig = 0;
+        pending_replies--;
+    }
+    st->pid = -1;
+    active--;
+    tombstones++;
+    if (senders[(i + 1) & (MAX_SENDERS - 1)].pid != 0)
+        return;
+    while (senders[i].pid == -1) {
+        senders[i].pid = 0;
+        tombstones--;
+        i = (i - 1) & (MAX_SENDERS - 1);
+    }
+}
+
+// Ответить передатчику RT-сигналом. Очередь сигналов общая на пользователя: когда её
+// заполнили сами передатчики, sigqueue возвращает EAGAIN. Ждать нельзя - очередь
+// освобождает только сам сервер, поэтому ответ откладывается до разбора следующей пачки.
+// Новый ответ заменяет отложенный: подтверждения накопительные.
+static void reply(sender_state_t *st, int sig, union sigval v) {
+    int was_pending = st->reply_sig != 0;
+    if (sigqueue(st->pid, sig, v) == 0 || errno != EAGAIN) {
+        st->reply_sig = 0;
+        pending_replies -= was_pending;
+        if (st->finished)
+            remove_sender(st);
+        return;
+    }
+    st->reply_sig = sig;
+    st->reply_val = v;
+    pending_replies += !was_pending;
+}
+
+// Повторить отложенные ответы
+static void retry_replies(void) {
+    for (int i = 0; i < MAX_SENDERS && pending_replies; i++) {
+        sender_state_t *st = &senders[i];
+        if (st->pid > 0 && st->reply_sig)
+            reply(st, st->reply_sig, st->reply_val);
+    }
+}
+
+int serve_many(int quiet) {
+    // Все сигналы протокола блокируются и читаются только через signalfd
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    sigaddset(&set, SIGUSR2);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    sigaddset(&set, SIG_START);
+    sigaddset(&set, SIG_WORD);
+    sigaddset(&set, SIG_END);
+    sigaddset(&set, SIG_BIT);
+    sigaddset(&set, SIG_ACK);
+    sigaddset(&set, SIG_BULK);
+    sigprocmask(SIG_BLOCK, &set, NULL);
+
+    int sfd = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    if (sfd == -1 || ep == -1) {
+        perror("signalfd/epoll");
+        return 1;
+    }
+    struct epoll_event ev = { .events = EPOLLIN, .data.fd = sfd };
+    if (epoll_ctl(ep, EPOLL_CTL_ADD, sfd, &ev) == -1) {
+        perror("epoll_ctl");
+        return 1;
+    }
+    printf("Serving senders, Ctrl+C to stop\n");
+    fflush(stdout);
+
+    uint64_t total_signals = 0, total_values = 0, finished = 0; // Общая статистика
+    long long start = 0, report = now_ns(), last = 0;
+    uint64_t report_values = 0;
+    int running = 1;
+
+    while (running) {
+        int n = epoll_wait(ep, &ev, 1, 1000);
+        long long now = now_ns();
+        if (start && now - report >= 1000000000LL) {
+            printf("Active senders: %d, values/s: %.0f\n", active,
+                   (total_values - report_values) * 1e9 / (now - report));
+            fflush(stdout);
+            report = now;
+            report_values = total_values;
+        }
+        if (n <= 0) {
+            // Новых сигналов нет, но отложенные ответы повторяем: передатчик ждёт именно их
+            if (pending_replies)
+                retry_replies();
+            continue;
+        }
+
+        // Сигналы читаются пачками: один read возвращает сразу много структур
+        struct signalfd_siginfo si[64];
+        ssize_t len;
+        while ((len = read(sfd, si, sizeof(si))) > 0) {
+            for (int i = 0; i < (int)(len / sizeof(si[0])); i++) {
+                int sig = si[i].ssi_signo;
+                pid_t from = si[i].ssi_pid;
+                total_signals++;
+                if (!start)
+                    start = now;
+                last = now;
+
+                // Ctrl+C с клавиатуры (или SIGTERM) останавливает сервер; SIGINT от
+                // передатчика (SI_USER с известным PID) - конец исходной побитовой передачи
+                sender_state_t *st = find_sender(from, 0);
+                if (sig == SIGTERM || (sig == SIGINT && (si[i].ssi_code != SI_USER || !st))) {
+                    running = 0;
+                    continue;
+                }
+
+                if (sig == SIG_BIT) {
+                    // Бит с номером: новый передатчик начинает с нулевого бита, а повтор
+                    // бита уже закончившего передатчика не заводит новое состояние
+                    uint32_t seq = BIT_SEQ(si[i].ssi_int);
+                    if (!st && (seq != 0 || !(st = find_sender(from, 1))))
+                        continue;
+                    st->proto = PROTO_RT_BITS;
+                    if (seq == (uint32_t)st->nbits) {
+                        st->bits = (st->bits << 1) | (uint32_t)BIT_OF(si[i].ssi_int);
+                        st->nbits++;
+                    } else if (seq < (uint32_t)st->nbits) {
+                        st->out_of_order++;
+                    } else {
+                        continue;
+                    }
+                    union sigval v = { .sival_int = (int)seq };
+                    reply(st, SIG_ACK, v);
+                } else if (sig == SIGUSR1 || sig == SIGUSR2) {
+                    if (!st && !(st = find_sender(from, 1)))
+                        continue; // таблица заполнена
+                    st->proto = PROTO_BITS;
+                    st->bits = (st->bits << 1) | (uint32_t)(sig == SIGUSR2);
+                    st->nbits++;
+                    kill(from, SIGUSR1);
+                } else if (sig == SIGINT || (sig == SIG_END && st && st->proto == PROTO_RT_BITS)) {
+                    if (!quiet && st->out_of_order)
+                        printf("Sender %d: Result = %d, duplicate bits = %llu\n", from,
+                               (int32_t)st->bits, (unsigned long long)st->out_of_order);
+                    else if (!quiet)
+                        printf("Sender %d: Result = %d\n", from, (int32_t)st->bits);
+                    total_values += st->nbits > 32 ? st->nbits / 32 : 1;
+                    finished++;
+                    remove_sender(st);
+                } else if (sig == SIG_START) {
+                    if (!st && !(st = find_sender(from, 1)))
+                        continue;
+                    st->proto = PROTO_WORDS;
+                    st->width = START_WIDTH(si[i].ssi_int);
+                    st->window = START_WINDOW(si[i].ssi_int);
+                    st->ack_every = st->window > 1 ? st->window / 2 : 1;
+                } else if (sig == SIG_WORD && st) {
+                    uint64_t w;
+                    if (st->window) {
+                        if (SEQ_OF((void *)(uintptr_t)si[i].ssi_ptr) != (uint32_t)st->words) {
+                            st->out_of_order++;
+                            continue;
+                        }
+                        w = WORD_OF((void *)(uintptr_t)si[i].ssi_ptr);
+                    } else {
+                        w = st->width == 64 ? si[i].ssi_ptr : (uint32_t)si[i].ssi_int;
+                    }
+                    st->sum += w;
+                    st->words++;
+                    total_values++;
+                    if (st->window && st->words % st->ack_every == 0) {
+                        union sigval v = { .sival_ptr = (void *)(uintptr_t)st->words };
+                        reply(st, SIG_ACK, v);
+                    }
+                } else if (sig == SIG_END && st) {
+                    if (!quiet)
+                        printf("Sender %d: received %llu of %llu words, sum = %llu\n", from,
+                               (unsigned long long)st->words, (unsigned long long)si[i].ssi_ptr,
+                               (unsigned long long)st->sum);
+                    finished++;
+                    st->finished = 1;
+                    union sigval v = { .sival_ptr = (void *)(uintptr_t)st->words };
+                    reply(st, SIG_END, v);
+                } else if (sig == SIG_BULK && BULK_KIND((void *)(uintptr_t)si[i].ssi_ptr)) {
+                    // Передачу буфера сервер не поддерживает: на первый сигнал сразу отвечаем
+                    // SIG_END с нулём принятых байтов, чтобы передатчик не ждал вечно.
+                    // Второй сигнал (адрес или дескриптор) пропускается
+                    if (!st && !(st = find_sender(from, 1)))
+                        continue;
+                    if (!quiet)
+                        printf("Sender %d: bulk transfer is not supported in server mode\n", from);
+                    st->finished = 1;
+                    union sigval v = { .sival_ptr = NULL };
+                    reply(st, SIG_END, v);
+                }
+            }
+            if (pending_replies)
+                retry_replies();
+        }
+        if (pending_replies)
+            retry_replies();
+    }
+
+    double seconds = (last - start) / 1e9;
+    printf("Finished transfers: %llu, values: %llu, signals: %llu, still active: %d\n",
+           (unsigned long long)finished, (unsigned long long)total_values,
+           (unsigned long long)total_signals, active);
+    printf("Throughput = %.0f values/s, %.0f signals/s\n", seconds > 0 ? total_values / seconds : 0,
+           seconds > 0 ? total_signals / seconds : 0);
+    close(sfd);
+    close(ep);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int quiet = 0;  // -q: не печатать каждое слово
+    int server = 0; // -s: обслуживать много передатчиков
+    const char *out_path = NULL; // -o: куда записать принятый буфер
+    int c;
+
+    while ((c = getopt(argc, argv, "qsl:o:")) != -1) {
+        switch (c) {
+        case 'q': quiet = 1; break;
+        case 's': server = 1; break;
+        case 'l': loss_percent = atoi(optarg); break;
+        case 'o': out_path = optarg; break;
+        default:
+            fprintf(stderr, "Usage: %s [-q] [-s] [-l loss%%] [-o file]\n", argv[0]);
+            return 1;
+        }
+    }
+
     // Печать PID приёмника
     printf("Receiver PID: %d\n", getpid());
+    // Серверу PID передатчиков не нужны: их сообщает ssi_pid
+    if (server)
+        return serve_many(quiet);
     // Запрос PID отправителя
     printf("Input sender PID: ");
     // Считываем PID отправителя
@@ -52,10 +531,83 @@ int main(void) {
     // Обработчик SIGINT для окончания передачи
     signal(SIGINT,  handle_end);
 
-    // Ждем SIGINT
-    while (!done)
+    // Обработчик пословной передачи: режим приёмник узнаёт по первому сигналу
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = handle_word;
+    sa.sa_flags = SA_SIGINFO;
+    // Пока работает обработчик, остальные сигналы протокола ждут: иначе ядро вложит
+    // обработчик SIG_END раньше обработчика уже выбранного SIG_WORD и порядок нарушится
+    sigemptyset(&sa.sa_mask);
+    sigaddset(&sa.sa_mask, SIG_START);
+    sigaddset(&sa.sa_mask, SIG_WORD);
+    sigaddset(&sa.sa_mask, SIG_END);
+    sigaddset(&sa.sa_mask, SIG_BIT);
+    sigaddset(&sa.sa_mask, SIG_BULK);
+    sigaction(SIG_START, &sa, NULL);
+    sigaction(SIG_WORD, &sa, NULL);
+    sigaction(SIG_END, &sa, NULL);
+    sigaction(SIG_BIT, &sa, NULL);
+    sigaction(SIG_BULK, &sa, NULL);
+    rand_state = (uint32_t)getpid() * 2654435761u | 1;
+
+    // Сигналы протокола блокируются и принимаются только внутри sigsuspend:
+    // сигнал, пришедший между проверкой done и ожиданием, не потеряется
+    sigset_t block, wait_mask;
+    sigemptyset(&block);
+    sigaddset(&block, SIGUSR1);
+    sigaddset(&block, SIGUSR2);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIG_START);
+    sigaddset(&block, SIG_WORD);
+    sigaddset(&block, SIG_END);
+    sigaddset(&block, SIG_BIT);
+    sigaddset(&block, SIG_BULK);
+    sigprocmask(SIG_BLOCK, &block, &wait_mask);
+
+    // Ждем SIGINT (или SIG_END при пословной передаче)
+    uint64_t printed = 0;
+    while (!done) {
         // Остановка
-        pause();
+        sigsuspend(&wait_mask);
+        // Печатаем принятые слова (если печать отстала больше чем на SEEN_SIZE, пропускаем)
+        for (; !quiet && word_width && printed < words; printed++)
+            if (words - printed <= SEEN_SIZE)
+                printf("Word %llu = %llu\n", (unsigned long long)printed,
+                       (unsigned long long)seen[printed % SEEN_SIZE]);
+    }
+
+    if (bulk_kind) {
+        uint64_t sum;
+        uint64_t got = receive_bulk(out_path, &sum);
+        double seconds = (now_ns() - start_ns) / 1e9;
+        // Ответ отпускает буфер передатчика
+        union sigval v = { .sival_ptr = (void *)(uintptr_t)got };
+        queue_signal(pid, SIG_END, v);
+        printf("Received %llu of %llu bytes (%s), checksum = %016llx\n", (unsigned long long)got,
+               (unsigned long long)bulk_len, bulk_kind == BULK_VM ? "process_vm_readv" : "pidfd_getfd",
+               (unsigned long long)sum);
+        printf("Throughput = %.2f GB/s\n", seconds > 0 ? got / seconds / 1e9 : 0);
+        return 0;
+    }
+
+    if (word_width) {
+        for (; !quiet && printed < words; printed++)
+            if (words - printed <= SEEN_SIZE)
+                printf("Word %llu = %llu\n", (unsigned long long)printed,
+                       (unsigned long long)seen[printed % SEEN_SIZE]);
+        // Подтверждаем конец передачи числом принятых слов
+        union sigval v = { .sival_ptr = (void *)(uintptr_t)words };
+        queue_signal(pid, SIG_END, v);
+
+        double seconds = (end_ns - start_ns) / 1e9;
+        printf("Received %llu of %llu words (%d-bit), sum = %llu\n", (unsigned long long)words,
+               (unsigned long long)words_expected, word_width, (unsigned long long)words_sum);
+        if (window)
+            printf("Window = %u, out of order = %llu\n", window, (unsigned long long)out_of_order);
+        printf("Throughput = %.0f values/s\n", seconds > 0 ? words / seconds : 0);
+        return 0;
+    }
 
     // Из беззнакового в знаковое
     int32_t result = (int32_t)value;
@@ -64,6 +616,9 @@ int main(void) {
     print_bits32(value);
     // Печатаем восстановленное десятичное значение
     printf("Result = %d\n", result);
+    if (rt_bits)
+        printf("Bits = %u, duplicates = %llu, lost = %llu\n", rt_bits,
+               (unsigned long long)duplicates, (unsigned long long)lost);
 
     return 0;
 }
@@ -1,18 +1,36 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <signal.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+#include "proto.h"
 
-// Флаг, получен ли приёмник
-volatile sig_atomic_t ack_received = 0;
 // PID приёмника
 pid_t pid = 0;
 
-// Обработчик SIGUSR1 от приёмника
-void handle_ack(int sig) {
-    (void)sig;
-    ack_received = 1;
+// Границы таймаута повторной передачи бита (RTO)
+#define RTO_INITIAL_NS 10000000LL  // 10 мс, пока время обмена не измерено
+#define RTO_MIN_NS     1000000LL   // 1 мс
+#define RTO_MAX_NS     1000000000LL // 1 с
+
+// Разбор размера с суффиксом K, M или G
+static uint64_t parse_size(const char *str) {
+    char *end;
+    uint64_t n = strtoull(str, &end, 0);
+    switch (*end) {
+    case 'G': case 'g': n <<= 10; /* fallthrough */
+    case 'M': case 'm': n <<= 10; /* fallthrough */
+    case 'K': case 'k': n <<= 10;
+    }
+    return n;
 }
 
 // Функция печати 32‑битного числа в двоичном виде
@@ -22,9 +40,277 @@ void print_bits32(uint32_t u) {
     putchar('\n');
 }
 
-int main(void) {
+// Пословная передача: каждое слово уходит одним RT-сигналом через sigqueue.
+// count > 0 - отправить count сгенерированных слов, иначе слова читаются со стандартного ввода.
+// window > 0 - скользящее окно: без подтверждения в пути не больше window слов.
+int send_words(int width, long long count, long window) {
+    // Подтверждения ждём через sigwaitinfo, поэтому блокируем их заранее
+    sigset_t set, ack_set;
+    sigemptyset(&set);
+    sigaddset(&set, SIG_END);
+    sigemptyset(&ack_set);
+    sigaddset(&ack_set, SIG_ACK);
+    sigaddset(&set, SIG_ACK);
+    sigprocmask(SIG_BLOCK, &set, NULL);
+    sigdelset(&set, SIG_ACK);
+
+    union sigval v;
+    v.sival_int = START_VALUE(width, window);
+    if (queue_signal(pid, SIG_START, v) == -1) {
+        perror("sigqueue");
+        return 1;
+    }
+    if (!count)
+        printf("Input decimal integer numbers (Ctrl+D to finish): ");
+    fflush(stdout);
+
+    long long start = now_ns();
+    long long sent = 0;
+    long long acked = 0;  // Сколько слов приёмник подтвердил
+    long long stalls = 0; // Сколько раз окно было заполнено
+    uint64_t sum = 0;
+    long long x;
+    siginfo_t info;
+    while (count ? sent < count : scanf("%lld", &x) == 1) {
+        // Сгенерированные слова: умножение на нечётную константу задействует все разряды
+        uint64_t w = count ? (uint64_t)sent * 0x9E3779B97F4A7C15ULL : (uint64_t)x;
+        if (window) {
+            // Окно заполнено - ждём накопительного подтверждения
+            if (sent - acked >= window)
+                stalls++;
+            while (sent - acked >= window) {
+                if (sigwaitinfo(&ack_set, &info) == -1)
+                    continue;
+                long long n = (uintptr_t)info.si_value.sival_ptr;
+                if (n > acked)
+                    acked = n;
+            }
+            w = (uint32_t)w;
+            v.sival_ptr = PACK_SEQ(sent, w);
+        } else if (width == 32) {
+            w = (uint32_t)w;
+            v.sival_int = (int32_t)w;
+        } else {
+            v.sival_ptr = (void *)(uintptr_t)w; // sival_ptr занимает 64 бита
+        }
+        if (queue_signal(pid, SIG_WORD, v) == -1) {
+            perror("sigqueue");
+            return 1;
+        }
+        sum += w;
+        sent++;
+    }
+
+    v.sival_ptr = (void *)(uintptr_t)sent;
+    if (queue_signal(pid, SIG_END, v) == -1) {
+        perror("sigqueue");
+        return 1;
+    }
+    // Приёмник отвечает числом принятых слов
+    while (sigwaitinfo(&set, &info) == -1)
+        ;
+    double seconds = (now_ns() - start) / 1e9;
+
+    printf("Sent %lld words, sum = %llu, receiver got %llu\n", sent, (unsigned long long)sum,
+           (unsigned long long)(uintptr_t)info.si_value.sival_ptr);
+    if (window)
+        printf("Window = %ld, window full %lld times\n", window, stalls);
+    if (count)
+        printf("Throughput = %.0f values/s\n", seconds > 0 ? sent / seconds : 0);
+    return 0;
+}
+
+// Ждать SIG_ACK с номером seq до момента deadline (в нс). Старые подтверждения
+// (на повторно отправленные биты) пропускаются. Возвращает 1, если подтверждение пришло.
+static int wait_ack(const sigset_t *ack_set, uint32_t seq, long long deadline) {
+    siginfo_t info;
+    while (1) {
+        long long left = deadline - now_ns();
+        if (left <= 0)
+            return 0;
+        struct timespec ts = { left / 1000000000LL, left % 1000000000LL };
+        if (sigtimedwait(ack_set, &info, &ts) == -1) {
+            if (errno == EAGAIN)
+                return 0;
+            continue; // EINTR
+        }
+        if ((uint32_t)info.si_value.sival_int == seq)
+            return 1;
+    }
+}
+
+// Побитовая передача на RT-сигналах: сигналы не склеиваются, поэтому один приёмник может
+// обслуживать много передатчиков сразу (receiver -s). Значение SIG_BIT - (номер бита << 1) | бит,
+// SIG_ACK возвращает номер принятого бита. Если подтверждение не пришло за RTO, бит уходит
+// снова, а приёмник по номеру узнаёт повтор и только подтверждает его - передача не встанет,
+// даже если сигнал или подтверждение потерялись. RTO подстраивается под измеренное время
+// обмена, как в TCP: srtt + 4 * rttvar, при таймауте удваивается.
+// Число передаётся reps раз, чтобы замерить скорость.
+int send_bits_rt(uint32_t u, int32_t number, long long reps) {
+    sigset_t ack_set;
+    sigemptyset(&ack_set);
+    sigaddset(&ack_set, SIG_ACK);
+    sigprocmask(SIG_BLOCK, &ack_set, NULL);
+
+    long long srtt = 0, rttvar = 0, rto = RTO_INITIAL_NS;
+    long long retransmits = 0;
+    uint32_t seq = 0;
+    long long start = now_ns();
+
+    for (long long r = 0; r < reps; r++) {
+        for (int i = 31; i >= 0; --i, seq++) {
+            union sigval v = { .sival_int = BIT_VALUE(seq, (u >> i) & 1) };
+            for (int tries = 0;; tries++) {
+                long long sent_at = now_ns();
+                if (queue_signal(pid, SIG_BIT, v) == -1) {
+                    perror("sigqueue");
+                    return 1;
+                }
+                if (wait_ack(&ack_set, seq, sent_at + rto)) {
+                    // Время обмена меряем только без повторов: иначе неясно, на какую
+                    // из отправок пришло подтверждение (алгоритм Карна)
+                    if (tries == 0) {
+                        long long rtt = now_ns() - sent_at;
+                        if (srtt == 0) {
+                            srtt = rtt;
+                            rttvar = rtt / 2;
+                        } else {
+                            long long err = rtt > srtt ? rtt - srtt : srtt - rtt;
+                            rttvar += (err - rttvar) / 4;
+                            srtt += (rtt - srtt) / 8;
+                        }
+                        rto = srtt + 4 * rttvar;
+                        if (rto < RTO_MIN_NS)
+                            rto = RTO_MIN_NS;
+                    }
+                    break;
+                }
+                retransmits++;
+                rto = rto * 2 > RTO_MAX_NS ? RTO_MAX_NS : rto * 2;
+            }
+        }
+    }
+    double seconds = (now_ns() - start) / 1e9;
+
+    union sigval v = { .sival_ptr = (void *)(uintptr_t)seq };
+    if (queue_signal(pid, SIG_END, v) == -1) {
+        perror("sigqueue");
+        return 1;
+    }
+    printf("Result = %d\n", number);
+    printf("Bits = %u, retransmits = %lld, RTO = %.0f us\n", seq, retransmits, rto / 1000.0);
+    printf("Throughput = %.0f bits/s\n", seconds > 0 ? seq / seconds : 0);
+    return 0;
+}
+
+// Передача буфера (-m bulk): сигналы служат только каналом управления. Передатчик отображает
+// в память файл path (без файла - memfd из size сгенерированных байт) и двумя сигналами SIG_BULK
+// сообщает длину и адрес буфера (BULK_VM) или номер дескриптора (BULK_FD). Данные приёмник
+// забирает сам: process_vm_readv читает прямо из памяти передатчика, а pidfd_getfd даёт копию
+// дескриптора, который приёмник отображает у себя. Ответ SIG_END с числом прочитанных байт
+// значит, что буфер больше не нужен.
+int send_bulk(const char *path, uint64_t size, int kind) {
+    int fd;
+    if (path) {
+        struct stat st;
+        fd = open(path, O_RDONLY);
+        if (fd == -1 || fstat(fd, &st) == -1) {
+            perror(path);
+            return 1;
+        }
+        size = st.st_size;
+    } else {
+        fd = memfd_create("bulk", 0);
+        if (fd == -1 || ftruncate(fd, size) == -1) {
+            perror("memfd_create");
+            return 1;
+        }
+    }
+    char *buf = NULL;
+    if (size) {
+        buf = mmap(NULL, size, path ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+        if (buf == MAP_FAILED) {
+            perror("mmap");
+            return 1;
+        }
+    }
+    if (!path)
+        for (uint64_t i = 0; i + 8 <= size; i += 8) {
+            uint64_t w = i * 0x9E3779B97F4A7C15ULL;
+            memcpy(buf + i, &w, 8);
+        }
+    uint64_t sum = bulk_checksum(0, buf, size);
+
+    // Чужую память и дескрипторы можно брать только с правом трассировки. При Yama
+    // ptrace_scope = 1 оно есть лишь у родителя, поэтому приёмнику разрешаем явно
+    // (без Yama prctl вернёт ошибку, и она не мешает)
+    prctl(PR_SET_PTRACER, pid, 0, 0, 0);
+
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIG_END);
+    sigprocmask(SIG_BLOCK, &set, NULL);
+
+    long long start = now_ns();
+    union sigval v = { .sival_ptr = BULK_VALUE(kind, size) };
+    if (queue_signal(pid, SIG_BULK, v) == -1) {
+        perror("sigqueue");
+        return 1;
+    }
+    // Сигналы с одним номером доставляются по порядку, поэтому второй придёт после первого
+    v.sival_ptr = kind == BULK_VM ? (void *)buf : (void *)(uintptr_t)fd;
+    if (queue_signal(pid, SIG_BULK, v) == -1) {
+        perror("sigqueue");
+        return 1;
+    }
+    siginfo_t info;
+    while (sigwaitinfo(&set, &info) == -1)
+        ;
+    double seconds = (now_ns() - start) / 1e9;
+
+    printf("Sent %llu bytes (%s), checksum = %016llx, receiver got %llu\n", (unsigned long long)size,
+           kind == BULK_VM ? "process_vm_readv" : "pidfd_getfd", (unsigned long long)sum,
+           (unsigned long long)(uintptr_t)info.si_value.sival_ptr);
+    printf("Throughput = %.2f GB/s\n", seconds > 0 ? size / seconds / 1e9 : 0);
+    if (buf)
+        munmap(buf, size);
+    close(fd);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
     // Исходное число
     int32_t number;
+    int words = 0;        // -m word: пословная передача вместо побитовой
+    int width = 32;       // -w: ширина слова, 32 или 64
+    long long count = 0;  // -n: сколько слов сгенерировать, 0 - читать числа с ввода
+    long window = 0;      // -m window: размер окна (-W)
+    int rt = 0;           // -r: побитовая передача на RT-сигналах
+    int bulk = 0;         // -m bulk: передача буфера, -t vm|fd - способ
+    const char *path = NULL; // -f: файл для передачи буфера
+    int c;
+
+    while ((c = getopt(argc, argv, "m:w:n:W:rf:t:")) != -1) {
+        switch (c) {
+        case 'r': rt = 1; break;
+        case 'm':
+            words = strcmp(optarg, "word") == 0 || strcmp(optarg, "window") == 0;
+            if (strcmp(optarg, "window") == 0 && !window)
+                window = 64;
+            if (strcmp(optarg, "bulk") == 0 && !bulk)
+                bulk = BULK_VM;
+            break;
+        case 'W': window = atol(optarg); break;
+        case 'w': width = atoi(optarg) == 64 ? 64 : 32; break;
+        case 'n': count = parse_size(optarg); break;
+        case 'f': path = optarg; break;
+        case 't': bulk = strcmp(optarg, "fd") == 0 ? BULK_FD : BULK_VM; break;
+        default:
+            fprintf(stderr, "Usage: %s [-m bits|word|window|bulk] [-r] [-w 32|64] [-n count] [-W window]\n"
+                            "       [-f file] [-t vm|fd]\n", argv[0]);
+            return 1;
+        }
+    }
 
     // Печать PID отправителя
     printf("Sender pid = %d\n", getpid());
@@ -37,8 +323,28 @@ int main(void) {
         return 1;
     }
 
-    // Назначаем функцию handle_ack обработчиком SIGUSR1
-    signal(SIGUSR1, handle_ack);
+    if (bulk)
+        return send_bulk(path, count, bulk);
+    if (window) {
+        // Все слова окна и подтверждения должны поместиться в очередь RT-сигналов
+        struct rlimit rl;
+        if (getrlimit(RLIMIT_SIGPENDING, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY &&
+            (rlim_t)window > rl.rlim_cur / 2) {
+            window = rl.rlim_cur / 2;
+            printf("Window limited to %ld by RLIMIT_SIGPENDING\n", window);
+        }
+        words = 1;
+        width = 32;
+    }
+    if (words)
+        return send_words(width, count, window);
+
+    // Подтверждение SIGUSR1 блокируем заранее и ждём через sigwaitinfo: если оно придёт
+    // сразу после kill, то останется ожидающим, а не потеряется между проверкой флага и pause()
+    sigset_t ack_set;
+    sigemptyset(&ack_set);
+    sigaddset(&ack_set, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &ack_set, NULL);
 
     // Запрашиваем числа у пользователя
     printf("Input decimal integer number: ");
@@ -55,6 +361,9 @@ int main(void) {
     // Печатаем двоичное представление исходного числа
     print_bits32(u);
 
+    if (rt)
+        return send_bits_rt(u, number, count ? count : 1);
+
     // Цикл отправки 32 бит от старшего к младшему
     for (int i = 31; i >= 0; --i) {
         // Выделяем бит
@@ -62,9 +371,6 @@ int main(void) {
         // Выбираем сигнал
         int sig = bit ? SIGUSR2 : SIGUSR1;
 
-        // Сбрасываем флаг подтверждения перед отправкой
-        ack_received = 0;
-
         // Отправляем выбранный сигнал приёмнику
         if (kill(pid, sig) == -1) {
             // Обработка ошибки
@@ -72,10 +378,9 @@ int main(void) {
             return 1;
         }
 
-        // Ждём установки флага = 0
-        while (!ack_received)
-            // Останавливаемся до прихода следующего сигнала
-            pause();
+        // Ждём подтверждения
+        while (sigwaitinfo(&ack_set, NULL) == -1)
+            ;
     }
 
     // После отправки всех битов посылаем SIGINT как сигнал конца передачи